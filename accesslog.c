@@ -0,0 +1,154 @@
+/**
+ * @file accesslog.c
+ * @brief Lock-free ring buffer and writer thread for the access log
+ *
+ * The ring is a bounded multi-producer, single-consumer queue in the
+ * style of a sequence-stamped circular array: each slot carries a
+ * sequence number that tells producers whether the slot is free and
+ * the consumer whether it is filled. A producer advances the head with
+ * a compare-and-swap only after observing that the target slot is free,
+ * so a full ring means the head simply stops moving: the record is
+ * counted as dropped, no slot is claimed, and the ring resumes intact
+ * as soon as the writer catches up.
+ *
+ * The writer thread drains the ring once per poll interval, doing the
+ * getnameinfo formatting of client addresses (numeric only, no reverse
+ * DNS) and the stdio buffering out of every request path.
+ */
+
+#include "accesslog.h"
+
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Slots in the ring; must be a power of two */
+#define ACCESSLOG_RING 4096
+
+/* Microseconds the writer sleeps when the ring is empty */
+#define ACCESSLOG_POLL_USECS 50000
+
+/**
+ * @brief One fixed-size log record
+ */
+typedef struct {
+    unsigned long seq;            /* Slot state; see ring protocol above */
+    struct sockaddr_storage addr; /* Client address, formatted by writer */
+    socklen_t addrlen;
+    char uri[ACCESSLOG_MAXURI];
+    size_t bytes;
+    bool hit;
+    time_t when;
+} log_record_t;
+
+static struct {
+    log_record_t ring[ACCESSLOG_RING];
+    unsigned long head; /* Next slot producers will claim */
+    unsigned long tail; /* Next slot the writer will drain */
+    unsigned long dropped;
+    FILE *file;
+} logger;
+
+/**
+ * @brief Writer thread: drains the ring and flushes formatted lines
+ *
+ * @param[in] arg - Unused
+ *
+ * @return Never returns
+ */
+static void *accesslog_writer(void *arg) {
+    (void)arg;
+    pthread_detach(pthread_self());
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+    while (true) {
+        log_record_t *rec = &logger.ring[logger.tail % ACCESSLOG_RING];
+        unsigned long seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if (seq != logger.tail + 1) {
+            /* Ring empty; flush what we have and nap */
+            fflush(logger.file);
+            usleep(ACCESSLOG_POLL_USECS);
+            continue;
+        }
+        if (getnameinfo((struct sockaddr *)&rec->addr, rec->addrlen, host,
+                        sizeof(host), port, sizeof(port),
+                        NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+            strcpy(host, "-");
+            strcpy(port, "-");
+        }
+        struct tm tm;
+        char stamp[32];
+        localtime_r(&rec->when, &tm);
+        strftime(stamp, sizeof(stamp), "%d/%b/%Y:%H:%M:%S", &tm);
+        fprintf(logger.file, "%s:%s [%s] \"%s\" %zu %s\n", host, port, stamp,
+                rec->uri, rec->bytes, rec->hit ? "hit" : "miss");
+        /* Mark the slot free for the producer one lap ahead */
+        __atomic_store_n(&rec->seq, logger.tail + ACCESSLOG_RING,
+                         __ATOMIC_RELEASE);
+        logger.tail++;
+    }
+    return NULL;
+}
+
+void accesslog_init(const char *path) {
+    logger.file = NULL;
+    if (path == NULL) {
+        return;
+    }
+    logger.file = fopen(path, "a");
+    if (logger.file == NULL) {
+        fprintf(stderr, "accesslog: cannot open %s\n", path);
+        return;
+    }
+    logger.head = 0;
+    logger.tail = 0;
+    logger.dropped = 0;
+    for (unsigned long i = 0; i < ACCESSLOG_RING; i++) {
+        logger.ring[i].seq = i;
+    }
+    pthread_t tid;
+    pthread_create(&tid, NULL, accesslog_writer, NULL);
+}
+
+void accesslog_record(const struct sockaddr_storage *addr, socklen_t addrlen,
+                      const char *uri, size_t bytes, bool hit) {
+    if (logger.file == NULL) {
+        return;
+    }
+    unsigned long pos = __atomic_load_n(&logger.head, __ATOMIC_RELAXED);
+    log_record_t *rec;
+    while (true) {
+        rec = &logger.ring[pos % ACCESSLOG_RING];
+        long behind = (long)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) -
+                             pos);
+        if (behind == 0) {
+            /* Slot is free; claim it by advancing the head past it. On
+             * failure pos holds the new head and the scan resumes */
+            if (__atomic_compare_exchange_n(&logger.head, &pos, pos + 1,
+                                            true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (behind < 0) {
+            /* Writer has not freed this slot: the ring is full. The
+             * head was never advanced past it, so dropping here leaves
+             * the ring well-formed rather than wedging the writer */
+            __atomic_fetch_add(&logger.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            /* Another producer claimed this slot first; rescan */
+            pos = __atomic_load_n(&logger.head, __ATOMIC_RELAXED);
+        }
+    }
+    rec->addr = *addr;
+    rec->addrlen = addrlen;
+    strncpy(rec->uri, uri, ACCESSLOG_MAXURI - 1);
+    rec->uri[ACCESSLOG_MAXURI - 1] = '\0';
+    rec->bytes = bytes;
+    rec->hit = hit;
+    rec->when = time(NULL);
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,49 @@
+/**
+ * @file accesslog.h
+ * @brief Interface for the proxy's asynchronous access log
+ *
+ * Workers record one fixed-size entry per request into a lock-free ring
+ * buffer; a dedicated writer thread formats the entries (including the
+ * numeric form of the client address) and flushes them to the log file.
+ * Recording never blocks: if the ring is full the entry is dropped and
+ * a drop counter is bumped, so logging can never add latency to the
+ * accept or request path.
+ *
+ * Logging is enabled by passing a file path to accesslog_init; with a
+ * NULL path every record call is a cheap no-op.
+ */
+
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+/* Bound on the URI prefix kept in a log record */
+#define ACCESSLOG_MAXURI 256
+
+/**
+ * @brief Initializes the access log and starts the writer thread
+ *
+ * Must be called once before accesslog_record.
+ *
+ * @param[in] path - Log file path, or NULL to disable logging
+ */
+void accesslog_init(const char *path);
+
+/**
+ * @brief Records one served request
+ *
+ * Safe to call from any thread; never blocks.
+ *
+ * @param[in] addr - The client's socket address
+ * @param[in] addrlen - Length of addr
+ * @param[in] uri - The request URI (truncated to ACCESSLOG_MAXURI)
+ * @param[in] bytes - Response bytes relayed to the client
+ * @param[in] hit - Whether the response came from the object cache
+ */
+void accesslog_record(const struct sockaddr_storage *addr, socklen_t addrlen,
+                      const char *uri, size_t bytes, bool hit);
+
+#endif /* ACCESSLOG_H */
@@ -0,0 +1,483 @@
+/**
+ * @file loadgen.c
+ * @brief Load generator and origin stub for benchmarking the proxy
+ *
+ * One binary plays both sides: it starts a built-in origin server on a
+ * local port, then drives the proxy under test with a configurable
+ * number of concurrent client threads. Each client issues GET requests
+ * through the proxy for objects served by the origin stub, with the
+ * object size, the hit/miss mix (requests to a small hot set of URLs
+ * versus unique URLs), and keep-alive behaviour all settable from the
+ * command line. At the end it reports requests per second, latency
+ * percentiles from the full sample set, and CPU time per request, so
+ * runs with identical flags are directly comparable across commits.
+ *
+ * Usage:
+ *   ./loadgen -p PROXYPORT [-H PROXYHOST] [-c THREADS] [-n REQUESTS]
+ *             [-s BYTES] [-r HITPCT] [-o ORIGINPORT] [-C]
+ *
+ *   -p  proxy port to drive (required)
+ *   -H  proxy host (default 127.0.0.1)
+ *   -c  concurrent client threads (default 8)
+ *   -n  total requests across all threads (default 10000)
+ *   -s  object size in bytes (default 8192)
+ *   -r  percent of requests aimed at the hot set (default 80)
+ *   -o  port for the built-in origin stub (default 18080)
+ *   -C  close the proxy connection after every request (keep-alive off)
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINEMAX 2048
+#define HOT_URLS 16
+
+/* Benchmark configuration, fixed after argument parsing */
+static struct {
+    const char *proxyHost;
+    const char *proxyPort;
+    int originPort;
+    int threads;
+    long requests;
+    long objectSize;
+    int hitPct;
+    int keepAlive;
+} cfg = {"127.0.0.1", NULL, 18080, 8, 10000, 8192, 80, 1};
+
+/* One worker's slice of the run and its results */
+typedef struct {
+    pthread_t tid;
+    long requests;      /* Requests this worker must issue */
+    long completed;     /* Requests that got a full response */
+    long failed;        /* Requests that errored or came back short */
+    long long *latency; /* Latency in microseconds per completed request */
+    unsigned seed;      /* Per-thread PRNG state for the hit/miss mix */
+    long unique;        /* Source of this worker's unique (miss) URLs */
+    int id;
+} worker_t;
+
+/**
+ * @brief Minimal buffered reader over a socket
+ */
+typedef struct {
+    int fd;
+    char buf[8192];
+    int pos;
+    int len;
+} conn_t;
+
+static void conn_init(conn_t *conn, int fd) {
+    conn->fd = fd;
+    conn->pos = 0;
+    conn->len = 0;
+}
+
+/**
+ * @brief Reads one LF-terminated line, NUL-terminated, CRLF stripped
+ *
+ * @return The line's length, 0 on a blank line, -1 on EOF or error
+ */
+static int conn_line(conn_t *conn, char *line, int cap) {
+    int used = 0;
+    while (used < cap - 1) {
+        if (conn->pos == conn->len) {
+            conn->len = (int)read(conn->fd, conn->buf, sizeof(conn->buf));
+            conn->pos = 0;
+            if (conn->len <= 0) {
+                return -1;
+            }
+        }
+        char c = conn->buf[conn->pos++];
+        if (c == '\n') {
+            break;
+        }
+        if (c != '\r') {
+            line[used++] = c;
+        }
+    }
+    line[used] = '\0';
+    return used;
+}
+
+/**
+ * @brief Consumes exactly n body bytes, discarding them
+ *
+ * @return 0 on success, -1 if the stream ended early
+ */
+static int conn_skip(conn_t *conn, long n) {
+    while (n > 0) {
+        if (conn->pos == conn->len) {
+            conn->len = (int)read(conn->fd, conn->buf, sizeof(conn->buf));
+            conn->pos = 0;
+            if (conn->len <= 0) {
+                return -1;
+            }
+        }
+        int take = conn->len - conn->pos;
+        if (take > n) {
+            take = (int)n;
+        }
+        conn->pos += take;
+        n -= take;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes the whole buffer, retrying short writes
+ */
+static int writeAll(int fd, const char *buf, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t put = write(fd, buf + done, n - done);
+        if (put <= 0) {
+            return -1;
+        }
+        done += (size_t)put;
+    }
+    return 0;
+}
+
+/**
+ * @brief Connects to a host and port, returning the socket
+ */
+static int connectTo(const char *host, const char *port) {
+    struct addrinfo hints;
+    struct addrinfo *list = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &list) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *p = list; p; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(list);
+    return fd;
+}
+
+/**
+ * @brief Serves one origin connection: parse requests, send sized bodies
+ *
+ * The requested object's size is encoded in its path ("/b<size>-...").
+ * Responses carry a Content-Length and the connection is kept alive
+ * until the client closes.
+ */
+static void *originConn(void *arg) {
+    int fd = (int)(long)arg;
+    pthread_detach(pthread_self());
+    conn_t conn;
+    conn_init(&conn, fd);
+    char line[LINEMAX];
+    static char body[65536];
+    memset(body, 'x', sizeof(body));
+    while (1) {
+        if (conn_line(&conn, line, sizeof(line)) <= 0) {
+            break;
+        }
+        long size = 0;
+        char *path = strchr(line, '/');
+        if (path != NULL && path[1] == 'b') {
+            size = atol(path + 2);
+        }
+        //Drain the header block
+        int n;
+        while ((n = conn_line(&conn, line, sizeof(line))) > 0) {
+        }
+        if (n < 0) {
+            break;
+        }
+        char head[LINEMAX];
+        int headLen = snprintf(head, sizeof(head),
+                               "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: application/octet-stream\r\n"
+                               "Content-Length: %ld\r\n\r\n",
+                               size);
+        if (writeAll(fd, head, (size_t)headLen) < 0) {
+            break;
+        }
+        long left = size;
+        while (left > 0) {
+            size_t chunk = left > (long)sizeof(body) ? sizeof(body)
+                                                     : (size_t)left;
+            if (writeAll(fd, body, chunk) < 0) {
+                break;
+            }
+            left -= (long)chunk;
+        }
+        if (left > 0) {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+/**
+ * @brief Origin stub: accepts connections and spawns a handler for each
+ */
+static void *originServer(void *arg) {
+    int listenFd = (int)(long)arg;
+    while (1) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t tid;
+        pthread_create(&tid, NULL, originConn, (void *)(long)fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Opens the origin stub's listening socket and starts its thread
+ */
+static int startOrigin(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)cfg.originPort);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 1024) < 0) {
+        close(fd);
+        return -1;
+    }
+    pthread_t tid;
+    pthread_create(&tid, NULL, originServer, (void *)(long)fd);
+    return 0;
+}
+
+static long long nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief One benchmark client: issues this worker's share of requests
+ *
+ * Requests aim at a small hot set of URLs with probability -r percent
+ * (repeat fetches the proxy can serve from cache) and at a unique URL
+ * otherwise (guaranteed misses). With keep-alive on, one connection to
+ * the proxy is reused until it closes; with -C each request opens a
+ * fresh connection.
+ */
+static void *clientWorker(void *arg) {
+    worker_t *w = (worker_t *)arg;
+    int fd = -1;
+    conn_t conn;
+    char req[LINEMAX];
+    char line[LINEMAX];
+    for (long i = 0; i < w->requests; i++) {
+        if (fd < 0) {
+            fd = connectTo(cfg.proxyHost, cfg.proxyPort);
+            if (fd < 0) {
+                w->failed++;
+                continue;
+            }
+            conn_init(&conn, fd);
+        }
+        int hot = (int)(rand_r(&w->seed) % 100) < cfg.hitPct;
+        long id = hot ? (long)(rand_r(&w->seed) % HOT_URLS)
+                      : (long)w->id * 100000000L + w->unique++;
+        int reqLen = snprintf(
+            req, sizeof(req),
+            "GET http://127.0.0.1:%d/b%ld-%s%ld HTTP/1.1\r\n"
+            "Host: 127.0.0.1:%d\r\n"
+            "%s"
+            "\r\n",
+            cfg.originPort, cfg.objectSize, hot ? "hot" : "miss", id,
+            cfg.originPort, cfg.keepAlive ? "" : "Connection: close\r\n");
+
+        long long start = nowUs();
+        int failed = writeAll(fd, req, (size_t)reqLen) < 0 ||
+                     conn_line(&conn, line, sizeof(line)) <= 0;
+        long contentLength = -1;
+        if (!failed) {
+            int n;
+            while ((n = conn_line(&conn, line, sizeof(line))) > 0) {
+                if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                    contentLength = atol(line + 15);
+                }
+            }
+            failed = n < 0 || contentLength < 0 ||
+                     conn_skip(&conn, contentLength) < 0;
+        }
+        if (failed) {
+            w->failed++;
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        w->latency[w->completed++] = nowUs() - start;
+        if (!cfg.keepAlive) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+static int cmpLatency(const void *a, const void *b) {
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static long long percentile(const long long *sorted, long count, int pct) {
+    if (count == 0) {
+        return 0;
+    }
+    long idx = (count * pct + 99) / 100 - 1;
+    if (idx < 0) {
+        idx = 0;
+    }
+    return sorted[idx];
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:H:c:n:s:r:o:C")) != -1) {
+        switch (opt) {
+        case 'p':
+            cfg.proxyPort = optarg;
+            break;
+        case 'H':
+            cfg.proxyHost = optarg;
+            break;
+        case 'c':
+            cfg.threads = atoi(optarg);
+            break;
+        case 'n':
+            cfg.requests = atol(optarg);
+            break;
+        case 's':
+            cfg.objectSize = atol(optarg);
+            break;
+        case 'r':
+            cfg.hitPct = atoi(optarg);
+            break;
+        case 'o':
+            cfg.originPort = atoi(optarg);
+            break;
+        case 'C':
+            cfg.keepAlive = 0;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s -p PROXYPORT [-H HOST] [-c THREADS] "
+                    "[-n REQUESTS] [-s BYTES] [-r HITPCT] [-o ORIGINPORT] "
+                    "[-C]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.proxyPort == NULL || cfg.threads < 1 || cfg.requests < 1) {
+        fprintf(stderr, "%s: -p PROXYPORT is required\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if (startOrigin() < 0) {
+        fprintf(stderr, "%s: cannot start origin stub on port %d\n", argv[0],
+                cfg.originPort);
+        return 1;
+    }
+    //Give the origin's accept loop a moment to come up
+    usleep(100000);
+
+    worker_t *workers = calloc((size_t)cfg.threads, sizeof(worker_t));
+    long perThread = cfg.requests / cfg.threads;
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    long long startUs = nowUs();
+    for (int i = 0; i < cfg.threads; i++) {
+        workers[i].id = i;
+        workers[i].requests = perThread;
+        workers[i].seed = (unsigned)(i + 1) * 2654435761u;
+        workers[i].latency = malloc((size_t)perThread * sizeof(long long));
+        pthread_create(&workers[i].tid, NULL, clientWorker, &workers[i]);
+    }
+    long completed = 0;
+    long failed = 0;
+    for (int i = 0; i < cfg.threads; i++) {
+        pthread_join(workers[i].tid, NULL);
+        completed += workers[i].completed;
+        failed += workers[i].failed;
+    }
+    long long elapsedUs = nowUs() - startUs;
+    struct rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    //Merge and sort every sample for exact percentiles
+    long long *all = malloc((size_t)completed * sizeof(long long));
+    long filled = 0;
+    for (int i = 0; i < cfg.threads; i++) {
+        memcpy(all + filled, workers[i].latency,
+               (size_t)workers[i].completed * sizeof(long long));
+        filled += workers[i].completed;
+        free(workers[i].latency);
+    }
+    qsort(all, (size_t)completed, sizeof(long long), cmpLatency);
+
+    double secs = (double)elapsedUs / 1e6;
+    double cpuUs =
+        (double)(after.ru_utime.tv_sec - before.ru_utime.tv_sec +
+                 after.ru_stime.tv_sec - before.ru_stime.tv_sec) *
+            1e6 +
+        (double)(after.ru_utime.tv_usec - before.ru_utime.tv_usec +
+                 after.ru_stime.tv_usec - before.ru_stime.tv_usec);
+
+    printf("config: threads=%d requests=%ld size=%ld hit=%d%% keepalive=%s\n",
+           cfg.threads, cfg.requests, cfg.objectSize, cfg.hitPct,
+           cfg.keepAlive ? "on" : "off");
+    printf("completed: %ld  failed: %ld  elapsed: %.2fs\n", completed, failed,
+           secs);
+    printf("throughput: %.0f req/s\n",
+           secs > 0 ? (double)completed / secs : 0);
+    printf("latency us: p50=%lld p90=%lld p99=%lld max=%lld\n",
+           percentile(all, completed, 50), percentile(all, completed, 90),
+           percentile(all, completed, 99),
+           completed > 0 ? all[completed - 1] : 0);
+    printf("loadgen cpu per request: %.1f us\n",
+           completed > 0 ? cpuUs / (double)completed : 0);
+
+    free(all);
+    free(workers);
+    return failed > 0 && completed == 0 ? 1 : 0;
+}
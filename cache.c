@@ -0,0 +1,202 @@
+/**
+ * @file cache.c
+ * @brief In-memory LRU web object cache for the proxy
+ *
+ * The cache is a doubly-linked list of heap-allocated entries guarded by
+ * a readers-writer lock. Lookups walk the list under the shared lock, so
+ * the common case (many threads serving repeat fetches of hot objects)
+ * never serializes. Recency is tracked with a global tick counter that
+ * each hit copies into the entry with an atomic store, which keeps
+ * lookups from needing the exclusive lock just to reorder an LRU list.
+ * Insertions and evictions take the exclusive lock; eviction scans for
+ * the entry with the smallest tick, which is cheap at the entry counts a
+ * 1MB cache can hold.
+ */
+
+#include "cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief A single cached web object
+ */
+typedef struct cache_entry {
+    char *key;                /* Heap copy of "host:port path" */
+    char *obj;                /* Heap copy of the object's bytes */
+    size_t size;              /* Size of obj in bytes */
+    unsigned long tick;       /* Recency stamp; larger is more recent */
+    time_t freshUntil;        /* Servable without revalidation until then */
+    cache_validators_t validators; /* ETag/Last-Modified for conditionals */
+    struct cache_entry *prev; /* Previous entry in the list */
+    struct cache_entry *next; /* Next entry in the list */
+} cache_entry_t;
+
+static struct {
+    cache_entry_t *head;   /* First entry, or NULL if empty */
+    size_t total;          /* Sum of entry sizes */
+    unsigned long clock;   /* Source of recency stamps */
+    pthread_rwlock_t lock; /* Shared for lookups, exclusive for updates */
+} cache;
+
+void cache_init(void) {
+    cache.head = NULL;
+    cache.total = 0;
+    cache.clock = 0;
+    pthread_rwlock_init(&cache.lock, NULL);
+}
+
+/**
+ * @brief Finds the entry with the given key
+ *
+ * Must be called with the lock held in either mode.
+ *
+ * @param[in] key - The key to look for
+ *
+ * @return The matching entry, or NULL if not present
+ */
+static cache_entry_t *cache_find(const char *key) {
+    for (cache_entry_t *entry = cache.head; entry; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Unlinks an entry from the list and frees it
+ *
+ * Must be called with the lock held exclusively.
+ *
+ * @param[in] entry - The entry to remove
+ */
+static void cache_remove(cache_entry_t *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache.head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+    cache.total -= entry->size;
+    free(entry->key);
+    free(entry->obj);
+    free(entry);
+}
+
+ssize_t cache_get(const char *key, char *buf, size_t bufsize) {
+    ssize_t result = -1;
+    pthread_rwlock_rdlock(&cache.lock);
+    cache_entry_t *entry = cache_find(key);
+    if (entry != NULL && entry->size <= bufsize &&
+        entry->freshUntil > time(NULL)) {
+        memcpy(buf, entry->obj, entry->size);
+        result = (ssize_t)entry->size;
+        /* Refresh recency without the exclusive lock; a torn or stale
+         * tick only perturbs the eviction order, never correctness */
+        __atomic_store_n(&entry->tick,
+                         __atomic_add_fetch(&cache.clock, 1, __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&cache.lock);
+    return result;
+}
+
+ssize_t cache_get_stale(const char *key, char *buf, size_t bufsize,
+                        cache_validators_t *validators) {
+    ssize_t result = -1;
+    pthread_rwlock_rdlock(&cache.lock);
+    cache_entry_t *entry = cache_find(key);
+    if (entry != NULL && entry->size <= bufsize) {
+        memcpy(buf, entry->obj, entry->size);
+        *validators = entry->validators;
+        result = (ssize_t)entry->size;
+    }
+    pthread_rwlock_unlock(&cache.lock);
+    return result;
+}
+
+void cache_touch(const char *key) {
+    pthread_rwlock_rdlock(&cache.lock);
+    cache_entry_t *entry = cache_find(key);
+    if (entry != NULL) {
+        /* A plain store is fine under the shared lock: readers only
+         * compare the value against the clock */
+        __atomic_store_n(&entry->freshUntil,
+                         time(NULL) + CACHE_FRESH_SECS, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&cache.lock);
+}
+
+void cache_put(const char *key, const char *obj, size_t size) {
+    cache_put_validated(key, obj, size, NULL);
+}
+
+void cache_put_validated(const char *key, const char *obj, size_t size,
+                         const cache_validators_t *validators) {
+    if (size == 0 || size > MAX_OBJECT_SIZE) {
+        return;
+    }
+
+    char *keyCopy = malloc(strlen(key) + 1);
+    char *objCopy = malloc(size);
+    if (keyCopy == NULL || objCopy == NULL) {
+        free(keyCopy);
+        free(objCopy);
+        return;
+    }
+    strcpy(keyCopy, key);
+    memcpy(objCopy, obj, size);
+
+    pthread_rwlock_wrlock(&cache.lock);
+
+    /* Replace any existing entry with the same key */
+    cache_entry_t *stale = cache_find(key);
+    if (stale != NULL) {
+        cache_remove(stale);
+    }
+
+    /* Evict least recently used entries until the new object fits */
+    while (cache.total + size > MAX_CACHE_SIZE && cache.head != NULL) {
+        cache_entry_t *victim = cache.head;
+        for (cache_entry_t *entry = cache.head->next; entry;
+             entry = entry->next) {
+            if (entry->tick < victim->tick) {
+                victim = entry;
+            }
+        }
+        cache_remove(victim);
+    }
+
+    cache_entry_t *entry = malloc(sizeof(cache_entry_t));
+    if (entry == NULL) {
+        pthread_rwlock_unlock(&cache.lock);
+        free(keyCopy);
+        free(objCopy);
+        return;
+    }
+    entry->key = keyCopy;
+    entry->obj = objCopy;
+    entry->size = size;
+    entry->freshUntil = time(NULL) + CACHE_FRESH_SECS;
+    if (validators != NULL) {
+        entry->validators = *validators;
+    } else {
+        entry->validators.etag[0] = '\0';
+        entry->validators.lastmod[0] = '\0';
+    }
+    entry->tick = __atomic_add_fetch(&cache.clock, 1, __ATOMIC_RELAXED);
+    entry->prev = NULL;
+    entry->next = cache.head;
+    if (cache.head) {
+        cache.head->prev = entry;
+    }
+    cache.head = entry;
+    cache.total += size;
+
+    pthread_rwlock_unlock(&cache.lock);
+}
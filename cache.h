@@ -0,0 +1,124 @@
+/**
+ * @file cache.h
+ * @brief Interface for the proxy's in-memory web object cache
+ *
+ * The cache stores complete HTTP response objects keyed by the string
+ * "host:port path" that the proxy derives from each request URI. Total
+ * cache size and individual object size are both bounded; when an
+ * insertion would exceed the total bound, the least recently used
+ * objects are evicted until it fits.
+ *
+ * The cache is safe for concurrent use by multiple threads. Lookups
+ * take a shared (read) lock so concurrent readers never serialize
+ * against each other; only insertions and evictions take the exclusive
+ * lock. Objects returned by cache_get are copied into a caller-owned
+ * buffer, so no cache memory is exposed outside the lock.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Bound on the total bytes of object data the cache may hold */
+#define MAX_CACHE_SIZE (1024 * 1024)
+
+/* Bound on the size of a single cacheable object */
+#define MAX_OBJECT_SIZE (100 * 1024)
+
+/* Seconds an object is served without revalidation */
+#define CACHE_FRESH_SECS 60
+
+/* Bound on a stored ETag or Last-Modified value (with terminator) */
+#define CACHE_VAL_MAX 128
+
+/**
+ * @brief Validators stored with an object for conditional revalidation
+ *
+ * Either field may be an empty string when the origin did not supply
+ * the corresponding header.
+ */
+typedef struct {
+    char etag[CACHE_VAL_MAX];     /* ETag header value */
+    char lastmod[CACHE_VAL_MAX];  /* Last-Modified header value */
+} cache_validators_t;
+
+/**
+ * @brief Initializes the cache
+ *
+ * Must be called once before any other cache function.
+ */
+void cache_init(void);
+
+/**
+ * @brief Looks up a fresh object by key and copies it into the given buffer
+ *
+ * On a hit, the object's bytes are copied into buf and its recency is
+ * refreshed for LRU purposes. Objects older than CACHE_FRESH_SECS are
+ * not returned here; use cache_get_stale to retrieve them for
+ * conditional revalidation.
+ *
+ * @param[in] key - The object's key ("host:port path")
+ * @param[out] buf - Buffer to receive the object's bytes
+ * @param[in] bufsize - Capacity of buf; must be at least MAX_OBJECT_SIZE
+ *
+ * @return The object's size in bytes on a hit
+ * @return -1 on a miss or if the object would not fit in buf
+ */
+ssize_t cache_get(const char *key, char *buf, size_t bufsize);
+
+/**
+ * @brief Looks up an object regardless of freshness
+ *
+ * Used on the revalidation path: the expired object's bytes and its
+ * stored validators are copied out so the caller can issue a
+ * conditional GET and serve the body directly on a 304.
+ *
+ * @param[in] key - The object's key ("host:port path")
+ * @param[out] buf - Buffer to receive the object's bytes
+ * @param[in] bufsize - Capacity of buf; must be at least MAX_OBJECT_SIZE
+ * @param[out] validators - Receives the stored validators
+ *
+ * @return The object's size in bytes if present
+ * @return -1 if absent or the object would not fit in buf
+ */
+ssize_t cache_get_stale(const char *key, char *buf, size_t bufsize,
+                        cache_validators_t *validators);
+
+/**
+ * @brief Renews an object's freshness after a 304 Not Modified
+ *
+ * @param[in] key - The object's key ("host:port path")
+ */
+void cache_touch(const char *key);
+
+/**
+ * @brief Inserts an object into the cache
+ *
+ * Objects larger than MAX_OBJECT_SIZE are ignored. If an object with
+ * the same key is already present it is replaced. Least recently used
+ * objects are evicted as needed to respect MAX_CACHE_SIZE.
+ *
+ * @param[in] key - The object's key ("host:port path")
+ * @param[in] obj - The object's bytes
+ * @param[in] size - The object's size in bytes
+ */
+void cache_put(const char *key, const char *obj, size_t size);
+
+/**
+ * @brief Inserts an object together with its revalidation validators
+ *
+ * Like cache_put, but also stores the origin's ETag and Last-Modified
+ * values so the object can be revalidated with a conditional GET once
+ * it goes stale.
+ *
+ * @param[in] key - The object's key ("host:port path")
+ * @param[in] obj - The object's bytes
+ * @param[in] size - The object's size in bytes
+ * @param[in] validators - Validators to store, or NULL for none
+ */
+void cache_put_validated(const char *key, const char *obj, size_t size,
+                         const cache_validators_t *validators);
+
+#endif /* CACHE_H */
@@ -0,0 +1,122 @@
+/**
+ * @file connpool.c
+ * @brief Upstream connection pool with idle-socket reaping
+ *
+ * The pool is a fixed array of slots guarded by a single mutex. Each
+ * slot holds one idle socket together with the origin it is connected
+ * to and the time it was returned. Checkout scans for a matching slot;
+ * release fills the first empty slot or closes the socket if none is
+ * free. The array is small enough that linear scans are cheaper than
+ * any hashing would be.
+ *
+ * A detached reaper thread wakes once a second and closes sockets that
+ * have been idle longer than CONNPOOL_IDLE_SECS, which keeps the proxy
+ * from reusing connections the origin has already torn down.
+ */
+
+#include "connpool.h"
+#include "csapp.h"
+#include "dnscache.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Bound on stored host strings; origins longer than this are simply
+ * never pooled */
+#define CONNPOOL_MAXHOST 256
+
+/**
+ * @brief One idle pooled connection
+ */
+typedef struct {
+    int fd;                       /* Socket, or -1 if the slot is empty */
+    char host[CONNPOOL_MAXHOST];  /* Origin hostname */
+    int port;                     /* Origin port */
+    time_t idleSince;             /* When the socket was returned */
+} pool_slot_t;
+
+static struct {
+    pool_slot_t slots[CONNPOOL_SLOTS];
+    pthread_mutex_t mutex;
+} pool;
+
+/**
+ * @brief Reaper thread that closes stale idle sockets
+ *
+ * @param[in] arg - Unused
+ *
+ * @return Never returns
+ */
+static void *connpool_reaper(void *arg) {
+    (void)arg;
+    pthread_detach(pthread_self());
+    while (true) {
+        sleep(1);
+        time_t now = time(NULL);
+        pthread_mutex_lock(&pool.mutex);
+        for (int i = 0; i < CONNPOOL_SLOTS; i++) {
+            if (pool.slots[i].fd >= 0 &&
+                now - pool.slots[i].idleSince > CONNPOOL_IDLE_SECS) {
+                close(pool.slots[i].fd);
+                pool.slots[i].fd = -1;
+            }
+        }
+        pthread_mutex_unlock(&pool.mutex);
+    }
+    return NULL;
+}
+
+void connpool_init(void) {
+    for (int i = 0; i < CONNPOOL_SLOTS; i++) {
+        pool.slots[i].fd = -1;
+    }
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_t tid;
+    pthread_create(&tid, NULL, connpool_reaper, NULL);
+}
+
+int connpool_get(const char *host, int port, bool *reused) {
+    int fd = -1;
+    pthread_mutex_lock(&pool.mutex);
+    for (int i = 0; i < CONNPOOL_SLOTS; i++) {
+        if (pool.slots[i].fd >= 0 && pool.slots[i].port == port &&
+            strcmp(pool.slots[i].host, host) == 0) {
+            fd = pool.slots[i].fd;
+            pool.slots[i].fd = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    *reused = fd >= 0;
+    if (fd >= 0) {
+        return fd;
+    }
+    return dnscache_connect(host, port);
+}
+
+void connpool_release(int fd, const char *host, int port, bool reusable) {
+    if (fd < 0) {
+        return;
+    }
+    if (!reusable || strlen(host) >= CONNPOOL_MAXHOST) {
+        close(fd);
+        return;
+    }
+    pthread_mutex_lock(&pool.mutex);
+    for (int i = 0; i < CONNPOOL_SLOTS; i++) {
+        if (pool.slots[i].fd < 0) {
+            pool.slots[i].fd = fd;
+            strcpy(pool.slots[i].host, host);
+            pool.slots[i].port = port;
+            pool.slots[i].idleSince = time(NULL);
+            fd = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * @file connpool.h
+ * @brief Interface for the proxy's upstream connection pool
+ *
+ * The pool keeps idle HTTP/1.1 keep-alive sockets to origin servers so
+ * repeat fetches to the same (host, port) skip the TCP handshake. A
+ * connection is checked out with connpool_get, used for exactly one
+ * request/response exchange, and then either returned to the pool (if
+ * the response was cleanly framed and the origin did not ask to close)
+ * or closed.
+ *
+ * A background reaper thread closes pooled sockets that have sat idle
+ * for longer than CONNPOOL_IDLE_SECS, so stale connections to origins
+ * that have silently timed out are not handed back to workers.
+ *
+ * All functions are safe for concurrent use by multiple threads.
+ */
+
+#ifndef CONNPOOL_H
+#define CONNPOOL_H
+
+#include <stdbool.h>
+
+/* Maximum number of idle upstream sockets held across all origins */
+#define CONNPOOL_SLOTS 64
+
+/* Seconds a pooled socket may sit idle before the reaper closes it */
+#define CONNPOOL_IDLE_SECS 30
+
+/**
+ * @brief Initializes the pool and starts the idle-socket reaper thread
+ *
+ * Must be called once before any other connpool function.
+ */
+void connpool_init(void);
+
+/**
+ * @brief Obtains a connected socket to the given origin
+ *
+ * Returns a pooled idle socket when one is available, otherwise opens a
+ * fresh connection with open_clientfd.
+ *
+ * Origins close idle keep-alive sockets on their own schedule, so a
+ * pooled descriptor may be dead on arrival; reused reports whether the
+ * socket came from the pool so the caller can retry a failed exchange
+ * once on a fresh connection.
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ * @param[out] reused - Set to true if the socket came from the pool
+ *
+ * @return A connected socket descriptor on success
+ * @return -1 if a connection could not be established
+ */
+int connpool_get(const char *host, int port, bool *reused);
+
+/**
+ * @brief Returns a socket to the pool or closes it
+ *
+ * Pass reusable=true only if the response on this socket was fully
+ * consumed with known framing and the origin did not send
+ * "Connection: close". If the pool is full or the socket is not
+ * reusable it is closed.
+ *
+ * @param[in] fd - The socket obtained from connpool_get
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ * @param[in] reusable - Whether the socket may carry another request
+ */
+void connpool_release(int fd, const char *host, int port,
+                      bool reusable);
+
+#endif /* CONNPOOL_H */
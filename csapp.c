@@ -472,6 +472,56 @@ ssize_t rio_writen(int fd, const void *usrbuf, size_t n) {
     return (ssize_t)n;
 }
 
+/*
+ * rio_writev - Robustly write an iovec array (unbuffered)
+ *
+ *    Gathers up to RIO_IOVCNT_MAX buffers into writev() calls, handling
+ *    short writevs and EINTR by advancing a local copy of the array, so
+ *    callers can send several pieces in one syscall without first
+ *    copying them into a staging buffer.
+ */
+ssize_t rio_writev(int fd, const struct iovec *iov, int iovcnt) {
+    struct iovec local[RIO_IOVCNT_MAX];
+    size_t total = 0;
+    int cur = 0;
+
+    if (iovcnt <= 0 || iovcnt > RIO_IOVCNT_MAX) {
+        return -1;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        local[i] = iov[i];
+        total += iov[i].iov_len;
+    }
+
+    while (cur < iovcnt) {
+        if (local[cur].iov_len == 0) {
+            cur++;
+            continue;
+        }
+        ssize_t nwritten = writev(fd, &local[cur], iovcnt - cur);
+        if (nwritten < 0) {
+            if (errno != EINTR) {
+                return -1; /* errno set by writev() */
+            }
+
+            /* Interrupted by sig handler return, call writev() again */
+            nwritten = 0;
+        }
+        while (nwritten > 0) {
+            if ((size_t)nwritten >= local[cur].iov_len) {
+                nwritten -= (ssize_t)local[cur].iov_len;
+                local[cur].iov_len = 0;
+                cur++;
+            } else {
+                local[cur].iov_base = (char *)local[cur].iov_base + nwritten;
+                local[cur].iov_len -= (size_t)nwritten;
+                nwritten = 0;
+            }
+        }
+    }
+    return (ssize_t)total;
+}
+
 /*
  * rio_read - This is a wrapper for the Unix read() function that
  *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
@@ -484,7 +534,7 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n) {
     size_t cnt;
 
     while (rp->rio_cnt <= 0) { /* Refill if buf is empty */
-        rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, sizeof(rp->rio_buf));
+        rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, rp->rio_bufsize);
         if (rp->rio_cnt < 0) {
             if (errno != EINTR) {
                 return -1; /* errno set by read() */
@@ -513,9 +563,23 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n) {
  * rio_readinitb - Associate a descriptor with a read buffer and reset buffer
  */
 void rio_readinitb(rio_t *rp, int fd) {
+    rio_readinitb_sz(rp, fd, RIO_BUFSIZE);
+}
+
+/*
+ * rio_readinitb_sz - Like rio_readinitb, but cap the internal buffer's
+ *     working size. Streams that only shuttle small pieces can use a
+ *     smaller working set so each refill touches less cache; sizes of
+ *     zero or beyond RIO_BUFSIZE fall back to the full buffer.
+ */
+void rio_readinitb_sz(rio_t *rp, int fd, size_t bufsize) {
+    if (bufsize == 0 || bufsize > RIO_BUFSIZE) {
+        bufsize = RIO_BUFSIZE;
+    }
     rp->rio_fd = fd;
     rp->rio_cnt = 0;
     rp->rio_bufptr = rp->rio_buf;
+    rp->rio_bufsize = bufsize;
 }
 
 /*
@@ -567,6 +631,53 @@ ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) {
     return (ssize_t)(n - 1);
 }
 
+/*
+ * rio_readb_until - Robustly read bytes up to and including a delimiter
+ *     (buffered). The internal buffer is scanned with memchr and the
+ *     span is copied with one memcpy instead of byte at a time,
+ *     refilling as needed. The result is NUL-terminated like
+ *     rio_readlineb. Returns the number of bytes read (excluding the
+ *     NUL), 0 on EOF with no data read, or -1 on error; a full user
+ *     buffer without the delimiter returns maxlen - 1 bytes.
+ */
+ssize_t rio_readb_until(rio_t *rp, void *usrbuf, size_t maxlen, char delim) {
+    char *bufp = usrbuf;
+    size_t n = 0;
+
+    while (n + 1 < maxlen) {
+        if (rp->rio_cnt <= 0) { /* Refill if buf is empty */
+            rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, rp->rio_bufsize);
+            if (rp->rio_cnt < 0) {
+                if (errno != EINTR) {
+                    return -1; /* errno set by read() */
+                }
+
+                /* Interrupted by sig handler return, call read() again */
+                continue;
+            }
+            if (rp->rio_cnt == 0) {
+                break; /* EOF */
+            }
+            rp->rio_bufptr = rp->rio_buf;
+        }
+        size_t avail = (size_t)rp->rio_cnt;
+        if (avail > maxlen - 1 - n) {
+            avail = maxlen - 1 - n;
+        }
+        char *hit = memchr(rp->rio_bufptr, delim, avail);
+        size_t take = hit != NULL ? (size_t)(hit - rp->rio_bufptr) + 1 : avail;
+        memcpy(bufp + n, rp->rio_bufptr, take);
+        rp->rio_bufptr += take;
+        rp->rio_cnt -= (ssize_t)take;
+        n += take;
+        if (hit != NULL) {
+            break;
+        }
+    }
+    bufp[n] = 0;
+    return (ssize_t)n;
+}
+
 /********************************
  * Client/server helper functions
  ********************************/
@@ -626,13 +737,15 @@ int open_clientfd(const char *hostname, const char *port) {
 
 /*
  * open_listenfd - Open and return a listening socket on port. This
- *     function is reentrant and protocol-independent.
+ *     function is reentrant and protocol-independent. The _opts helper
+ *     carries the shared logic; see open_listenfd_reuseport below for
+ *     the variant used by the multi-process scaling mode.
  *
  *     On error, returns:
  *       -2 for getaddrinfo error
  *       -1 with errno set for other errors.
  */
-int open_listenfd(const char *port) {
+static int open_listenfd_opts(const char *port, int reuseport) {
     struct addrinfo hints, *listp, *p;
     int listenfd = -1, rc, optval = 1;
 
@@ -659,6 +772,16 @@ int open_listenfd(const char *port) {
         setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval,
                    sizeof(int));
 
+#ifdef SO_REUSEPORT
+        /* Lets multiple processes bind the port and share accepts */
+        if (reuseport) {
+            setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT,
+                       (const void *)&optval, sizeof(int));
+        }
+#else
+        (void)reuseport;
+#endif
+
         /* Bind the descriptor to the address */
         if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0) {
             break; /* Success */
@@ -684,3 +807,20 @@ int open_listenfd(const char *port) {
     }
     return listenfd;
 }
+
+int open_listenfd(const char *port) {
+    return open_listenfd_opts(port, 0);
+}
+
+/*
+ * open_listenfd_reuseport - Like open_listenfd, but sets SO_REUSEPORT
+ *     before binding so several processes can listen on the same port
+ *     and let the kernel balance accepted connections across them.
+ *
+ *     On error, returns:
+ *       -2 for getaddrinfo error
+ *       -1 with errno set for other errors.
+ */
+int open_listenfd_reuseport(const char *port) {
+    return open_listenfd_opts(port, 1);
+}
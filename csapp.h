@@ -41,6 +41,7 @@
 #include <stdarg.h>    /* va_list */
 #include <stddef.h>    /* size_t */
 #include <sys/types.h> /* ssize_t */
+#include <sys/uio.h>   /* struct iovec */
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
 #define DEF_MODE S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH
@@ -48,10 +49,12 @@
 
 /* Persistent state for the robust I/O (Rio) package */
 #define RIO_BUFSIZE 8192
+#define RIO_IOVCNT_MAX 16 /* Most iovecs one rio_writev call accepts */
 typedef struct {
     int rio_fd;                /* Descriptor for this internal buf */
     ssize_t rio_cnt;           /* Unread bytes in internal buf */
     char *rio_bufptr;          /* Next unread byte in internal buf */
+    size_t rio_bufsize;        /* Working size of the internal buffer */
     char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
 } rio_t;
 
@@ -93,12 +96,16 @@ void Free(void *ptr);
 /* Rio (Robust I/O) package */
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 ssize_t rio_writen(int fd, const void *usrbuf, size_t n);
+ssize_t rio_writev(int fd, const struct iovec *iov, int iovcnt);
 void rio_readinitb(rio_t *rp, int fd);
+void rio_readinitb_sz(rio_t *rp, int fd, size_t bufsize);
 ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t rio_readb_until(rio_t *rp, void *usrbuf, size_t maxlen, char delim);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(const char *hostname, const char *port);
 int open_listenfd(const char *port);
+int open_listenfd_reuseport(const char *port);
 
 #endif /* CSAPP_H */
@@ -0,0 +1,327 @@
+/**
+ * @file diskcache.c
+ * @brief Disk cache tier for objects too large for the memory cache
+ *
+ * The index is a fixed array of slots memory-mapped MAP_SHARED from a
+ * file in the cache directory, so entries written by one run are visible
+ * to the next without any load or replay step. Each key hashes to one
+ * slot (direct-mapped); a colliding insertion simply replaces the slot's
+ * previous occupant, which keeps both lookup and eviction O(1) and needs
+ * no free-space accounting beyond the slot count.
+ *
+ * The mapping is shared by every process on the directory - reuseport
+ * workers and the overlapping halves of a hot restart - so the lock
+ * guarding the slots lives inside the mapped header as a process-shared
+ * rwlock, and first-time initialization of the index is serialized with
+ * flock on the index file.
+ *
+ * Object files are named after their slot. Writers stream into a
+ * uniquely named temporary file and publish with rename(2), so a reader
+ * either opens the complete old object or the complete new one, never a
+ * partial write; readers that already hold a descriptor keep reading the
+ * old file unaffected.
+ */
+
+#include "diskcache.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/* Slots in the direct-mapped index */
+#define DISKCACHE_SLOTS 512
+
+/* Bound on a stored key (with terminator) */
+#define DISKCACHE_KEYLEN 512
+
+/* Identifies a compatible index file; bumped when the layout changes */
+#define DISKCACHE_MAGIC 0x58444351u
+
+/* Concurrent writers streaming into temporary files */
+#define DISKCACHE_PENDING 32
+
+/* Bound on the cache directory path */
+#define DISKCACHE_DIRLEN 1024
+
+/* Bound on a path inside the cache directory */
+#define DISKCACHE_PATHLEN (DISKCACHE_DIRLEN + 48)
+
+/**
+ * @brief One slot of the memory-mapped index
+ */
+typedef struct {
+    char key[DISKCACHE_KEYLEN]; /* The object's key, or "" if empty */
+    uint64_t size;              /* The object's size in bytes */
+} disk_slot_t;
+
+/**
+ * @brief Header at the start of the index file
+ */
+typedef struct {
+    uint32_t magic;        /* DISKCACHE_MAGIC for a compatible index */
+    uint32_t slots;        /* DISKCACHE_SLOTS when the index was created */
+    pthread_rwlock_t lock; /* Process-shared; guards the slots */
+} disk_header_t;
+
+/**
+ * @brief A writer's in-flight temporary file, keyed by descriptor
+ */
+typedef struct {
+    int fd;                       /* Descriptor handed to the writer */
+    char path[DISKCACHE_PATHLEN]; /* Temporary file's path */
+} disk_pending_t;
+
+static struct {
+    char dir[DISKCACHE_DIRLEN];  /* Cache directory, or "" if disabled */
+    disk_header_t *header;       /* Mapped index header */
+    disk_slot_t *slots;          /* Mapped index slots */
+    unsigned long tmpCounter;    /* Source of unique temp file names */
+    disk_pending_t pending[DISKCACHE_PENDING];
+    pthread_mutex_t pendingLock; /* Guards the pending table and the
+                                    temp-name counter; the mapped index
+                                    has its own process-shared lock */
+} disk;
+
+/**
+ * @brief Hashes a key to its index slot
+ *
+ * @param[in] key - The key to hash
+ *
+ * @return The slot index
+ */
+static unsigned long disk_hash(const char *key) {
+    unsigned long hash = 5381;
+    for (const char *c = key; *c; c++) {
+        hash = hash * 33 + (unsigned char)*c;
+    }
+    return hash % DISKCACHE_SLOTS;
+}
+
+/**
+ * @brief Formats the object file path for a slot
+ *
+ * @param[out] path - Buffer receiving the path
+ * @param[in] slot - The slot index
+ */
+static void disk_objpath(char path[DISKCACHE_PATHLEN], unsigned long slot) {
+    snprintf(path, DISKCACHE_PATHLEN, "%s/obj-%lu", disk.dir, slot);
+}
+
+void diskcache_init(const char *dir) {
+    disk.dir[0] = '\0';
+    disk.header = NULL;
+    if (dir == NULL || strlen(dir) >= sizeof(disk.dir)) {
+        return;
+    }
+    mkdir(dir, 0700);
+
+    char path[DISKCACHE_PATHLEN];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "diskcache: cannot open %s\n", path);
+        return;
+    }
+    //Several workers may open this directory at once; flock serializes
+    //first-time setup so exactly one of them initializes the index and
+    //its process-shared lock. Released when fd closes below
+    flock(fd, LOCK_EX);
+    size_t mapSize =
+        sizeof(disk_header_t) + DISKCACHE_SLOTS * sizeof(disk_slot_t);
+    if (ftruncate(fd, (off_t)mapSize) < 0) {
+        close(fd);
+        return;
+    }
+    void *map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "diskcache: cannot map %s\n", path);
+        close(fd);
+        return;
+    }
+    disk.header = map;
+    disk.slots = (disk_slot_t *)(disk.header + 1);
+    if (disk.header->magic != DISKCACHE_MAGIC ||
+        disk.header->slots != DISKCACHE_SLOTS) {
+        //Fresh or incompatible index; start it over. The slot lock must
+        //be process-shared: every process mapping this file locks
+        //through the header, not through private memory
+        memset(map, 0, mapSize);
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_rwlock_init(&disk.header->lock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+        disk.header->slots = DISKCACHE_SLOTS;
+        disk.header->magic = DISKCACHE_MAGIC;
+    }
+    close(fd);
+    strcpy(disk.dir, dir);
+    disk.tmpCounter = 0;
+    for (int i = 0; i < DISKCACHE_PENDING; i++) {
+        disk.pending[i].fd = -1;
+    }
+    pthread_mutex_init(&disk.pendingLock, NULL);
+}
+
+int diskcache_open(const char *key, size_t *size) {
+    if (disk.dir[0] == '\0' || strlen(key) >= DISKCACHE_KEYLEN) {
+        return -1;
+    }
+    unsigned long slot = disk_hash(key);
+    int fd = -1;
+    pthread_rwlock_rdlock(&disk.header->lock);
+    if (strcmp(disk.slots[slot].key, key) == 0) {
+        char path[DISKCACHE_PATHLEN];
+        disk_objpath(path, slot);
+        fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            *size = (size_t)disk.slots[slot].size;
+        }
+    }
+    pthread_rwlock_unlock(&disk.header->lock);
+    return fd;
+}
+
+ssize_t diskcache_send(int objFd, int fd, size_t size) {
+    size_t remaining = size;
+#ifdef __linux__
+    off_t offset = 0;
+    while (remaining > 0) {
+        ssize_t sent = sendfile(fd, objFd, &offset, remaining);
+        if (sent < 0) {
+            break;
+        }
+        if (sent == 0) {
+            return -1;
+        }
+        remaining -= (size_t)sent;
+    }
+    if (remaining == 0) {
+        return (ssize_t)size;
+    }
+    //sendfile unavailable or refused; fall back to the copy loop
+    if (lseek(objFd, 0, SEEK_SET) < 0) {
+        return -1;
+    }
+    remaining = size;
+#endif
+    char buf[8192];
+    while (remaining > 0) {
+        size_t want = remaining > sizeof(buf) ? sizeof(buf) : remaining;
+        ssize_t got = read(objFd, buf, want);
+        if (got <= 0) {
+            return -1;
+        }
+        ssize_t done = 0;
+        while (done < got) {
+            ssize_t put = write(fd, buf + done, (size_t)(got - done));
+            if (put <= 0) {
+                return -1;
+            }
+            done += put;
+        }
+        remaining -= (size_t)got;
+    }
+    return (ssize_t)size;
+}
+
+int diskcache_begin(size_t size) {
+    if (disk.dir[0] == '\0' || size == 0 || size > DISKCACHE_MAX_OBJECT) {
+        return -1;
+    }
+    char path[DISKCACHE_PATHLEN];
+    pthread_mutex_lock(&disk.pendingLock);
+    //Temp names carry the pid so workers sharing the directory never
+    //collide on O_EXCL
+    snprintf(path, sizeof(path), "%s/tmp-%d-%lu", disk.dir, (int)getpid(),
+             disk.tmpCounter++);
+    disk_pending_t *slot = NULL;
+    for (int i = 0; i < DISKCACHE_PENDING; i++) {
+        if (disk.pending[i].fd < 0) {
+            slot = &disk.pending[i];
+            break;
+        }
+    }
+    int fd = -1;
+    if (slot != NULL) {
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            slot->fd = fd;
+            strcpy(slot->path, path);
+        }
+    }
+    pthread_mutex_unlock(&disk.pendingLock);
+    return fd;
+}
+
+/**
+ * @brief Finds and clears the pending entry for a writer's descriptor
+ *
+ * Must be called with the pending lock held.
+ *
+ * @param[in] objFd - Descriptor returned by diskcache_begin
+ * @param[out] path - Receives the temporary file's path
+ *
+ * @return true if the descriptor had a pending entry
+ */
+static bool disk_pending_take(int objFd, char path[DISKCACHE_PATHLEN]) {
+    for (int i = 0; i < DISKCACHE_PENDING; i++) {
+        if (disk.pending[i].fd == objFd) {
+            strcpy(path, disk.pending[i].path);
+            disk.pending[i].fd = -1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void diskcache_commit(const char *key, int objFd, size_t size) {
+    if (disk.dir[0] == '\0' || strlen(key) >= DISKCACHE_KEYLEN) {
+        close(objFd);
+        return;
+    }
+    unsigned long slot = disk_hash(key);
+    char tmpPath[DISKCACHE_PATHLEN];
+    char objPath[DISKCACHE_PATHLEN];
+    disk_objpath(objPath, slot);
+    pthread_mutex_lock(&disk.pendingLock);
+    bool pending = disk_pending_take(objFd, tmpPath);
+    pthread_mutex_unlock(&disk.pendingLock);
+    if (pending) {
+        //The rename and the slot update publish together under the
+        //index lock so no process pairs one entry's key with another's
+        //size
+        pthread_rwlock_wrlock(&disk.header->lock);
+        if (rename(tmpPath, objPath) == 0) {
+            strcpy(disk.slots[slot].key, key);
+            disk.slots[slot].size = size;
+        }
+        pthread_rwlock_unlock(&disk.header->lock);
+    }
+    close(objFd);
+}
+
+void diskcache_abort(int objFd) {
+    if (disk.dir[0] == '\0') {
+        close(objFd);
+        return;
+    }
+    char tmpPath[DISKCACHE_PATHLEN];
+    pthread_mutex_lock(&disk.pendingLock);
+    if (disk_pending_take(objFd, tmpPath)) {
+        unlink(tmpPath);
+    }
+    pthread_mutex_unlock(&disk.pendingLock);
+    close(objFd);
+}
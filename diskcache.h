@@ -0,0 +1,95 @@
+/**
+ * @file diskcache.h
+ * @brief Interface for the proxy's disk cache tier for large objects
+ *
+ * Objects too large for the in-memory cache are spilled to files in a
+ * cache directory and served back with sendfile where available. The
+ * index of stored objects lives in a memory-mapped file in the same
+ * directory, so a restarted proxy sees its previous contents instead of
+ * cold-starting against the origin.
+ *
+ * The tier is opt-in: diskcache_init with a NULL directory leaves every
+ * other function a cheap no-op, mirroring the access log. Stored files
+ * hold the complete response (headers and body) exactly as the memory
+ * cache does, so a hit is a single file-to-socket copy.
+ */
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Bound on the size of a single disk-cached object */
+#define DISKCACHE_MAX_OBJECT (256UL * 1024 * 1024)
+
+/**
+ * @brief Initializes the disk tier rooted at the given directory
+ *
+ * The directory is created if needed and the on-disk index is mapped
+ * into memory; an index left by a previous run is picked up as-is.
+ *
+ * @param[in] dir - The cache directory, or NULL to disable the tier
+ */
+void diskcache_init(const char *dir);
+
+/**
+ * @brief Looks up an object and opens its file for reading
+ *
+ * @param[in] key - The object's key ("host:port path")
+ * @param[out] size - Receives the object's size in bytes on a hit
+ *
+ * @return A descriptor positioned at the start of the object on a hit
+ * @return -1 on a miss or if the tier is disabled
+ */
+int diskcache_open(const char *key, size_t *size);
+
+/**
+ * @brief Copies an opened object to a socket
+ *
+ * Uses sendfile where available so the bytes never enter user space;
+ * elsewhere a bounded read/write loop is used.
+ *
+ * @param[in] objFd - Descriptor returned by diskcache_open
+ * @param[in] fd - Destination socket
+ * @param[in] size - The object's size as reported by diskcache_open
+ *
+ * @return The number of bytes sent on success
+ * @return -1 if the copy failed partway
+ */
+ssize_t diskcache_send(int objFd, int fd, size_t size);
+
+/**
+ * @brief Starts writing a new object of the given expected size
+ *
+ * The object accumulates in a temporary file and becomes visible only
+ * on commit, so readers never observe a partially written object.
+ *
+ * @param[in] size - The expected total size in bytes
+ *
+ * @return A descriptor to stream the object's bytes into
+ * @return -1 if the tier is disabled or the size is out of bounds
+ */
+int diskcache_begin(size_t size);
+
+/**
+ * @brief Publishes a fully written object under the given key
+ *
+ * The temporary file is renamed into place atomically and the index
+ * entry updated; an existing object hashing to the same slot is
+ * replaced.
+ *
+ * @param[in] key - The object's key ("host:port path")
+ * @param[in] objFd - Descriptor returned by diskcache_begin
+ * @param[in] size - The number of bytes actually written
+ */
+void diskcache_commit(const char *key, int objFd, size_t size);
+
+/**
+ * @brief Discards a partially written object
+ *
+ * @param[in] objFd - Descriptor returned by diskcache_begin
+ */
+void diskcache_abort(int objFd);
+
+#endif /* DISKCACHE_H */
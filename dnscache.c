@@ -0,0 +1,276 @@
+/**
+ * @file dnscache.c
+ * @brief TTL-bounded DNS resolution cache for the connect path
+ *
+ * The cache is a fixed array of entries guarded by a mutex. Each entry
+ * holds the addresses getaddrinfo returned for one "host:port" key (or
+ * a negative marker for NXDOMAIN) and an expiry time. Lookup copies the
+ * addresses out under the lock and connects outside it, so a slow
+ * origin never holds up other threads' lookups. When the table is full
+ * the entry closest to expiry is replaced.
+ *
+ * Resolution itself runs outside the lock as well; if two threads race
+ * to resolve the same cold key, both resolve and the second store wins,
+ * which is harmless.
+ */
+
+#include "dnscache.h"
+#include "csapp.h"
+#include "timeout.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Number of origins the cache can hold */
+#define DNSCACHE_ENTRIES 64
+
+/* Addresses kept per origin */
+#define DNSCACHE_MAXADDRS 4
+
+/* Bound on stored keys; longer origins are resolved uncached */
+#define DNSCACHE_MAXKEY 280
+
+/**
+ * @brief One cached resolution result
+ */
+typedef struct {
+    char key[DNSCACHE_MAXKEY];  /* "host:port", empty if slot unused */
+    struct sockaddr_storage addrs[DNSCACHE_MAXADDRS];
+    socklen_t addrlens[DNSCACHE_MAXADDRS];
+    int naddrs;                 /* Stored address count */
+    bool negative;              /* True if resolution failed */
+    time_t expires;             /* When this entry becomes stale */
+} dns_entry_t;
+
+static struct {
+    dns_entry_t entries[DNSCACHE_ENTRIES];
+    pthread_mutex_t mutex;
+} dnscache;
+
+void dnscache_init(void) {
+    memset(dnscache.entries, 0, sizeof(dnscache.entries));
+    pthread_mutex_init(&dnscache.mutex, NULL);
+}
+
+/**
+ * @brief Copies a fresh cache entry for the key, if one exists
+ *
+ * @param[in] key - The "host:port" key
+ * @param[out] out - Receives a copy of the entry
+ *
+ * @return true if a fresh entry was found
+ */
+static bool dnscache_lookup(const char *key, dns_entry_t *out) {
+    bool found = false;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&dnscache.mutex);
+    for (int i = 0; i < DNSCACHE_ENTRIES; i++) {
+        if (dnscache.entries[i].key[0] != '\0' &&
+            dnscache.entries[i].expires > now &&
+            strcmp(dnscache.entries[i].key, key) == 0) {
+            *out = dnscache.entries[i];
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dnscache.mutex);
+    return found;
+}
+
+/**
+ * @brief Stores an entry, replacing the slot closest to expiry
+ *
+ * @param[in] entry - The entry to store
+ */
+static void dnscache_store(const dns_entry_t *entry) {
+    pthread_mutex_lock(&dnscache.mutex);
+    int victim = 0;
+    for (int i = 0; i < DNSCACHE_ENTRIES; i++) {
+        if (dnscache.entries[i].key[0] == '\0') {
+            victim = i;
+            break;
+        }
+        if (strcmp(dnscache.entries[i].key, entry->key) == 0) {
+            victim = i;
+            break;
+        }
+        if (dnscache.entries[i].expires < dnscache.entries[victim].expires) {
+            victim = i;
+        }
+    }
+    dnscache.entries[victim] = *entry;
+    pthread_mutex_unlock(&dnscache.mutex);
+}
+
+/**
+ * @brief Connects one socket to an address within the connect budget
+ *
+ * The connect is started non-blocking and waited for with poll, so an
+ * origin that neither accepts nor refuses ties the caller up for at
+ * most the configured budget instead of the kernel's default (which can
+ * be minutes). The socket is returned to blocking mode on success.
+ *
+ * @param[in] addr - The address to connect to
+ * @param[in] addrlen - Length of addr
+ *
+ * @return A connected socket descriptor, or -1 on failure or timeout
+ */
+static int dnscache_connect_one(const struct sockaddr_storage *addr,
+                                socklen_t addrlen) {
+    int fd = socket(addr->ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)addr, addrlen) < 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return -1;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        int soerr = 0;
+        socklen_t soerrlen = sizeof(soerr);
+        if (poll(&pfd, 1, timeout_connect_secs() * 1000) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &soerr, &soerrlen) < 0 ||
+            soerr != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    if (fcntl(fd, F_SETFL, flags) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Tries to connect to each address in an entry, in order
+ *
+ * @param[in] entry - A positive cache entry
+ *
+ * @return A connected socket descriptor, or -1 if all addresses failed
+ */
+static int dnscache_connect_addrs(const dns_entry_t *entry) {
+    for (int i = 0; i < entry->naddrs; i++) {
+        int fd = dnscache_connect_one(&entry->addrs[i], entry->addrlens[i]);
+        if (fd >= 0) {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Resolves a key with getaddrinfo and stores the result
+ *
+ * The entry's key field must already be filled in; on success (or a
+ * cacheable failure) the remaining fields are populated and the entry
+ * is stored.
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ * @param[in,out] entry - Entry with key set; receives the result
+ *
+ * @return 0 if addresses were resolved
+ * @return -1 on failure
+ */
+static int dnscache_resolve_entry(const char *host, int port,
+                                  dns_entry_t *entry) {
+    struct addrinfo hints;
+    struct addrinfo *listp;
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    int rc = getaddrinfo(host, service, &hints, &listp);
+    if (rc != 0) {
+        if (rc == EAI_NONAME) {
+            entry->naddrs = 0;
+            entry->negative = true;
+            entry->expires = time(NULL) + DNSCACHE_NEG_TTL_SECS;
+            dnscache_store(entry);
+        }
+        return -1;
+    }
+
+    entry->naddrs = 0;
+    entry->negative = false;
+    entry->expires = time(NULL) + DNSCACHE_TTL_SECS;
+    for (struct addrinfo *p = listp; p && entry->naddrs < DNSCACHE_MAXADDRS;
+         p = p->ai_next) {
+        if (p->ai_addrlen <= sizeof(struct sockaddr_storage)) {
+            memcpy(&entry->addrs[entry->naddrs], p->ai_addr, p->ai_addrlen);
+            entry->addrlens[entry->naddrs] = p->ai_addrlen;
+            entry->naddrs++;
+        }
+    }
+    freeaddrinfo(listp);
+    if (entry->naddrs == 0) {
+        return -1;
+    }
+    dnscache_store(entry);
+    return 0;
+}
+
+int dnscache_connect(const char *host, int port) {
+    dns_entry_t entry;
+    if (snprintf(entry.key, sizeof(entry.key), "%s:%d", host, port) >=
+        (int)sizeof(entry.key)) {
+        /* Key too long to cache; resolve the slow way */
+        char service[16];
+        snprintf(service, sizeof(service), "%d", port);
+        return open_clientfd(host, service);
+    }
+
+    if (dnscache_lookup(entry.key, &entry)) {
+        if (entry.negative) {
+            return -1;
+        }
+        int fd = dnscache_connect_addrs(&entry);
+        if (fd >= 0) {
+            return fd;
+        }
+        /* Stored addresses stopped working; fall through and re-resolve */
+    }
+
+    if (dnscache_resolve_entry(host, port, &entry) < 0) {
+        return -1;
+    }
+    return dnscache_connect_addrs(&entry);
+}
+
+int dnscache_resolve(const char *host, int port,
+                     struct sockaddr_storage *addr, socklen_t *addrlen) {
+    dns_entry_t entry;
+    if (snprintf(entry.key, sizeof(entry.key), "%s:%d", host, port) >=
+        (int)sizeof(entry.key)) {
+        return -1;
+    }
+    if (!dnscache_lookup(entry.key, &entry)) {
+        if (dnscache_resolve_entry(host, port, &entry) < 0) {
+            return -1;
+        }
+    } else if (entry.negative) {
+        return -1;
+    }
+    *addr = entry.addrs[0];
+    *addrlen = entry.addrlens[0];
+    return 0;
+}
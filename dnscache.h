@@ -0,0 +1,65 @@
+/**
+ * @file dnscache.h
+ * @brief Interface for the proxy's DNS resolution cache
+ *
+ * The cache sits in front of the resolver on the proxy's connect path.
+ * Resolved address lists are stored keyed by "host:port" with a bounded
+ * TTL, so repeat connections to a hot origin skip getaddrinfo entirely.
+ * Name-resolution failures (NXDOMAIN) are cached negatively with a
+ * short TTL so a misconfigured client cannot hammer the resolver.
+ *
+ * All functions are safe for concurrent use by multiple threads.
+ */
+
+#ifndef DNSCACHE_H
+#define DNSCACHE_H
+
+#include <sys/socket.h>
+
+/* Seconds a resolved address list stays valid */
+#define DNSCACHE_TTL_SECS 60
+
+/* Seconds a resolution failure stays cached */
+#define DNSCACHE_NEG_TTL_SECS 5
+
+/**
+ * @brief Initializes the DNS cache
+ *
+ * Must be called once before dnscache_connect.
+ */
+void dnscache_init(void);
+
+/**
+ * @brief Opens a connection to host:port, resolving through the cache
+ *
+ * Behaves like open_clientfd but consults the cache first; a fresh
+ * positive entry connects straight to the stored addresses and a fresh
+ * negative entry fails immediately without touching the resolver.
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ *
+ * @return A connected socket descriptor on success
+ * @return -1 if resolution or connection failed
+ */
+int dnscache_connect(const char *host, int port);
+
+/**
+ * @brief Resolves host:port through the cache without connecting
+ *
+ * Intended for callers that perform their own (typically non-blocking)
+ * connect, such as the event-driven engine. The first resolved address
+ * is returned; a cold key is resolved and cached as a side effect.
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ * @param[out] addr - Receives the resolved address
+ * @param[out] addrlen - Receives the address length
+ *
+ * @return 0 on success
+ * @return -1 if resolution failed
+ */
+int dnscache_resolve(const char *host, int port,
+                     struct sockaddr_storage *addr, socklen_t *addrlen);
+
+#endif /* DNSCACHE_H */
@@ -0,0 +1,690 @@
+/**
+ * @file event.c
+ * @brief Epoll-based event-driven connection engine
+ *
+ * Each event-loop thread owns an epoll instance; the shared listening
+ * socket is registered in every instance so the kernel spreads accepts
+ * across loops. A connection moves through a small state machine:
+ *
+ *   READ_REQUEST    accumulate the request head from the client
+ *   CONNECTING      non-blocking connect to the origin in progress
+ *   SEND_REQUEST    write the rewritten request head upstream
+ *   RELAY           copy origin bytes to the client as both sides allow
+ *   DRAIN           origin done (or cache hit); flush what remains
+ *
+ * All sockets are non-blocking; pending bytes toward the client sit in
+ * a growable per-connection buffer and epoll interest is recomputed
+ * whenever a connection's needs change. When the pending buffer passes
+ * a high-water mark the engine stops reading from the origin until the
+ * client catches up, so one slow client cannot balloon memory.
+ *
+ * Name resolution goes through the DNS cache; only a cold key costs a
+ * resolver round trip on the loop thread.
+ */
+
+#define _GNU_SOURCE /* for accept4 */
+
+#include "event.h"
+
+#include "cache.h"
+#include "csapp.h"
+#include "dnscache.h"
+#include "http_parser.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Shared with proxy.c */
+extern int parseUri(char *uri, const char **host, int *port,
+                    const char **path);
+extern parser_t *parserAcquire(void);
+extern const char *headerUserAgent(void);
+extern bool varyCacheable(const char *value);
+
+/* Events fetched per epoll_wait call */
+#define EV_MAXEVENTS 256
+
+/* Stop reading from the origin once this many bytes are pending */
+#define EV_HIGH_WATER (256 * 1024)
+
+/* Floor for event-loop thread count */
+#define EV_MIN_LOOPS 1
+
+/**
+ * @brief States of the per-connection machine
+ */
+typedef enum {
+    ST_READ_REQUEST,
+    ST_CONNECTING,
+    ST_SEND_REQUEST,
+    ST_RELAY,
+    ST_DRAIN
+} econn_state;
+
+struct econn;
+
+/**
+ * @brief Registration handle distinguishing the two sockets of a connection
+ *
+ * epoll hands back one pointer per ready descriptor; each connection
+ * registers its client and upstream sockets with separate tags so the
+ * dispatcher knows which side fired.
+ */
+typedef struct {
+    struct econn *conn;
+    bool upstream;
+} evtag_t;
+
+/**
+ * @brief Per-connection state for the event engine
+ */
+typedef struct econn {
+    int cfd;             /* Client socket */
+    int ufd;             /* Upstream socket, or -1 */
+    econn_state state;
+    evtag_t ctag;        /* Registered for cfd */
+    evtag_t utag;        /* Registered for ufd */
+    bool dead;           /* Close requested; free at end of batch */
+
+    char in[MAXLINE];    /* Request head accumulation */
+    size_t inlen;
+
+    char ureq[MAXLINE * 2]; /* Rewritten head bound for the origin */
+    size_t ureqlen;
+    size_t ureqoff;
+
+    char *out;           /* Bytes pending toward the client */
+    size_t outcap;
+    size_t outlen;
+    size_t outoff;
+
+    char key[MAXLINE * 2]; /* Object cache key */
+    char *object;        /* Response accumulation for the cache */
+    size_t objectLen;
+    bool cacheable;
+    bool complete;       /* Origin response fully received */
+
+    struct econn *nextDead; /* Deferred free list link */
+} econn_t;
+
+/**
+ * @brief Per-loop context
+ */
+typedef struct {
+    int epfd;
+    int listenfd;
+    econn_t *deadList; /* Connections closed during the current batch */
+} evloop_t;
+
+/**
+ * @brief Recomputes epoll interest for both of a connection's sockets
+ *
+ * @param[in] loop - The owning event loop
+ * @param[in] conn - The connection to update
+ */
+static void econn_update(evloop_t *loop, econn_t *conn) {
+    struct epoll_event ev;
+
+    uint32_t cmask = 0;
+    if (conn->state == ST_READ_REQUEST) {
+        cmask |= EPOLLIN;
+    }
+    if (conn->outlen > conn->outoff) {
+        cmask |= EPOLLOUT;
+    }
+    ev.events = cmask;
+    ev.data.ptr = &conn->ctag;
+    epoll_ctl(loop->epfd, EPOLL_CTL_MOD, conn->cfd, &ev);
+
+    if (conn->ufd >= 0) {
+        uint32_t umask = 0;
+        if (conn->state == ST_CONNECTING ||
+            (conn->state == ST_SEND_REQUEST &&
+             conn->ureqlen > conn->ureqoff)) {
+            umask |= EPOLLOUT;
+        }
+        if (conn->state == ST_RELAY &&
+            conn->outlen - conn->outoff < EV_HIGH_WATER) {
+            umask |= EPOLLIN;
+        }
+        ev.events = umask;
+        ev.data.ptr = &conn->utag;
+        epoll_ctl(loop->epfd, EPOLL_CTL_MOD, conn->ufd, &ev);
+    }
+}
+
+/**
+ * @brief Closes a connection and defers freeing it to the end of the batch
+ *
+ * Events already fetched in the current epoll batch may still reference
+ * this connection, so the struct is only marked dead here and freed
+ * once the batch has been fully dispatched.
+ *
+ * @param[in] loop - The owning event loop
+ * @param[in] conn - The connection to close
+ */
+static void econn_close(evloop_t *loop, econn_t *conn) {
+    if (conn->dead) {
+        return;
+    }
+    conn->dead = true;
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->cfd, NULL);
+    close(conn->cfd);
+    if (conn->ufd >= 0) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->ufd, NULL);
+        close(conn->ufd);
+        conn->ufd = -1;
+    }
+    free(conn->out);
+    free(conn->object);
+    conn->out = NULL;
+    conn->object = NULL;
+    conn->nextDead = loop->deadList;
+    loop->deadList = conn;
+}
+
+/**
+ * @brief Appends bytes to the pending-output buffer, growing it as needed
+ *
+ * @param[in] conn - The connection
+ * @param[in] data - Bytes to append
+ * @param[in] len - Number of bytes
+ *
+ * @return true on success, false if memory was exhausted
+ */
+static bool econn_out_append(econn_t *conn, const char *data, size_t len) {
+    if (conn->outlen + len > conn->outcap) {
+        size_t cap = conn->outcap ? conn->outcap : MAXBUF;
+        while (conn->outlen + len > cap) {
+            cap *= 2;
+        }
+        char *grown = realloc(conn->out, cap);
+        if (grown == NULL) {
+            return false;
+        }
+        conn->out = grown;
+        conn->outcap = cap;
+    }
+    memcpy(conn->out + conn->outlen, data, len);
+    conn->outlen += len;
+    return true;
+}
+
+/**
+ * @brief Writes as much pending output to the client as the socket allows
+ *
+ * @param[in] conn - The connection
+ *
+ * @return 0 on success (possibly with bytes still pending)
+ * @return -1 if the client connection failed
+ */
+static int econn_out_flush(econn_t *conn) {
+    while (conn->outoff < conn->outlen) {
+        ssize_t n = write(conn->cfd, conn->out + conn->outoff,
+                          conn->outlen - conn->outoff);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            return -1;
+        }
+        conn->outoff += (size_t)n;
+    }
+    conn->outoff = 0;
+    conn->outlen = 0;
+    return 0;
+}
+
+/**
+ * @brief Checks a buffered response's Vary headers before caching it
+ *
+ * The cache key carries only the Accept-Encoding axis, so a response
+ * that varies on anything else must not be stored. The head is scanned
+ * line by line up to its terminating blank line; an unterminated head
+ * is not cacheable either.
+ *
+ * @param[in] object - The buffered response (head and body)
+ * @param[in] len - The buffered length
+ *
+ * @return true if every Vary header permits caching
+ */
+static bool econn_vary_cacheable(const char *object, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        const char *line = object + pos;
+        const char *end = memchr(line, '\n', len - pos);
+        if (end == NULL) {
+            return false;
+        }
+        size_t lineLen = (size_t)(end - line) + 1;
+        if (lineLen <= 2) {
+            return true; /* Blank line; end of head */
+        }
+        if (lineLen > 5 && lineLen < MAXLINE &&
+            strncasecmp(line, "Vary:", 5) == 0) {
+            char value[MAXLINE];
+            memcpy(value, line + 5, lineLen - 5);
+            value[lineLen - 5] = '\0';
+            if (!varyCacheable(value)) {
+                return false;
+            }
+        }
+        pos += lineLen;
+    }
+    return false;
+}
+
+/**
+ * @brief Finishes a drained connection, inserting into the cache if complete
+ *
+ * @param[in] loop - The owning event loop
+ * @param[in] conn - The connection
+ */
+static void econn_finish(evloop_t *loop, econn_t *conn) {
+    if (conn->complete && conn->object != NULL &&
+        econn_vary_cacheable(conn->object, conn->objectLen)) {
+        cache_put(conn->key, conn->object, conn->objectLen);
+    }
+    econn_close(loop, conn);
+}
+
+/**
+ * @brief Builds the rewritten request head and starts the origin connect
+ *
+ * Called once the full request head has been read from the client. On a
+ * cache hit the object is queued directly and no upstream connection is
+ * made.
+ *
+ * @param[in] loop - The owning event loop
+ * @param[in] conn - The connection
+ */
+static void econn_dispatch(evloop_t *loop, econn_t *conn) {
+    const char *path;
+    const char *host;
+    int port;
+
+    /* Parse the request line */
+    char *lineEnd = strstr(conn->in, "\r\n");
+    if (lineEnd == NULL) {
+        econn_close(loop, conn);
+        return;
+    }
+    *lineEnd = '\0';
+    parser_t *parser = parserAcquire();
+    if (parser == NULL ||
+        parser_parse_line(parser, conn->in) != REQUEST) {
+        econn_close(loop, conn);
+        return;
+    }
+    *lineEnd = '\r';
+    const char *method;
+    const char *uri;
+    if (parser_retrieve(parser, METHOD, &method) < 0 ||
+        parser_retrieve(parser, URI, &uri) < 0 ||
+        strcmp(method, "GET") != 0 ||
+        parseUri((char *)uri, &host, &port, &path) < 0) {
+        econn_close(loop, conn);
+        return;
+    }
+
+    /* Classify the client's encoding class the same way the threaded
+     * path does: the key carries it, so a gzip body cached for one
+     * client is never replayed to one that did not offer gzip */
+    bool acceptsGzip = false;
+    for (const char *line = lineEnd + 2; line < conn->in + conn->inlen;) {
+        const char *next = strstr(line, "\r\n");
+        if (next == NULL) {
+            break;
+        }
+        if (strncasecmp(line, "Accept-Encoding:", 16) == 0) {
+            for (const char *c = line + 16; c + 4 <= next; c++) {
+                if (strncasecmp(c, "gzip", 4) == 0) {
+                    acceptsGzip = true;
+                    break;
+                }
+            }
+        }
+        line = next + 2;
+    }
+
+    /* Serve straight from the cache when possible */
+    conn->cacheable =
+        snprintf(conn->key, sizeof(conn->key), "%s:%d%s#%s", host, port, path,
+                 acceptsGzip ? "gz" : "id") < (int)sizeof(conn->key);
+    if (conn->cacheable) {
+        char *object = malloc(MAX_OBJECT_SIZE);
+        if (object != NULL) {
+            ssize_t objectLen = cache_get(conn->key, object, MAX_OBJECT_SIZE);
+            if (objectLen >= 0) {
+                bool queued =
+                    econn_out_append(conn, object, (size_t)objectLen);
+                free(object);
+                if (!queued || econn_out_flush(conn) < 0) {
+                    econn_close(loop, conn);
+                    return;
+                }
+                conn->state = ST_DRAIN;
+                if (conn->outlen == conn->outoff) {
+                    econn_close(loop, conn);
+                } else {
+                    econn_update(loop, conn);
+                }
+                return;
+            }
+            free(object);
+        }
+    }
+
+    /* Rewrite the head: request line, fixed headers, filtered client
+     * headers. The origin is asked to close so EOF ends the response. */
+    int n = snprintf(conn->ureq, sizeof(conn->ureq),
+                     "GET %s HTTP/1.1\r\n"
+                     "Host: %s:%d\r\n"
+                     "%s"
+                     "Connection: close\r\n",
+                     path, host, port, headerUserAgent());
+    if (n < 0 || (size_t)n >= sizeof(conn->ureq)) {
+        econn_close(loop, conn);
+        return;
+    }
+    conn->ureqlen = (size_t)n;
+    for (char *line = lineEnd + 2; line < conn->in + conn->inlen;) {
+        char *next = strstr(line, "\r\n");
+        if (next == NULL) {
+            break;
+        }
+        size_t len = (size_t)(next + 2 - line);
+        if (strncmp(line, "Host:", 5) != 0 &&
+            strncmp(line, "Connection:", 11) != 0 &&
+            strncmp(line, "User-Agent:", 11) != 0 &&
+            strncmp(line, "Proxy-Connection:", 17) != 0) {
+            if (conn->ureqlen + len >= sizeof(conn->ureq)) {
+                econn_close(loop, conn);
+                return;
+            }
+            memcpy(conn->ureq + conn->ureqlen, line, len);
+            conn->ureqlen += len;
+        }
+        line = next + 2;
+    }
+    /* The loop above copies the terminating blank line as well */
+
+    /* Begin a non-blocking connect to the origin */
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    if (dnscache_resolve(host, port, &addr, &addrlen) < 0) {
+        econn_close(loop, conn);
+        return;
+    }
+    conn->ufd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (conn->ufd < 0) {
+        econn_close(loop, conn);
+        return;
+    }
+    int rc = connect(conn->ufd, (struct sockaddr *)&addr, addrlen);
+    if (rc < 0 && errno != EINPROGRESS) {
+        econn_close(loop, conn);
+        return;
+    }
+    conn->state = (rc == 0) ? ST_SEND_REQUEST : ST_CONNECTING;
+
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.ptr = &conn->utag;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, conn->ufd, &ev) < 0) {
+        econn_close(loop, conn);
+        return;
+    }
+    econn_update(loop, conn);
+}
+
+/**
+ * @brief Handles readiness on the client socket
+ *
+ * @param[in] loop - The owning event loop
+ * @param[in] conn - The connection
+ */
+static void econn_client_ready(evloop_t *loop, econn_t *conn) {
+    /* Flush pending output first; RELAY/DRAIN progress depends on it */
+    if (econn_out_flush(conn) < 0) {
+        econn_close(loop, conn);
+        return;
+    }
+    if (conn->state == ST_DRAIN && conn->outlen == conn->outoff) {
+        econn_finish(loop, conn);
+        return;
+    }
+
+    if (conn->state == ST_READ_REQUEST) {
+        while (true) {
+            if (conn->inlen >= sizeof(conn->in) - 1) {
+                econn_close(loop, conn); /* Head too large */
+                return;
+            }
+            ssize_t n = read(conn->cfd, conn->in + conn->inlen,
+                             sizeof(conn->in) - 1 - conn->inlen);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                econn_close(loop, conn);
+                return;
+            }
+            if (n == 0) {
+                econn_close(loop, conn);
+                return;
+            }
+            conn->inlen += (size_t)n;
+            conn->in[conn->inlen] = '\0';
+            if (strstr(conn->in, "\r\n\r\n") != NULL) {
+                econn_dispatch(loop, conn);
+                return;
+            }
+        }
+    }
+    econn_update(loop, conn);
+}
+
+/**
+ * @brief Handles readiness on the upstream socket
+ *
+ * @param[in] loop - The owning event loop
+ * @param[in] conn - The connection
+ */
+static void econn_upstream_ready(evloop_t *loop, econn_t *conn) {
+    if (conn->state == ST_CONNECTING) {
+        int err = 0;
+        socklen_t errlen = sizeof(err);
+        if (getsockopt(conn->ufd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0 ||
+            err != 0) {
+            econn_close(loop, conn);
+            return;
+        }
+        conn->state = ST_SEND_REQUEST;
+    }
+
+    if (conn->state == ST_SEND_REQUEST) {
+        while (conn->ureqoff < conn->ureqlen) {
+            ssize_t n = write(conn->ufd, conn->ureq + conn->ureqoff,
+                              conn->ureqlen - conn->ureqoff);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    econn_update(loop, conn);
+                    return;
+                }
+                econn_close(loop, conn);
+                return;
+            }
+            conn->ureqoff += (size_t)n;
+        }
+        conn->state = ST_RELAY;
+        if (conn->cacheable) {
+            conn->object = malloc(MAX_OBJECT_SIZE);
+            conn->objectLen = 0;
+        }
+    }
+
+    if (conn->state == ST_RELAY) {
+        char buf[MAXBUF];
+        while (conn->outlen - conn->outoff < EV_HIGH_WATER) {
+            ssize_t n = read(conn->ufd, buf, sizeof(buf));
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                econn_close(loop, conn);
+                return;
+            }
+            if (n == 0) {
+                /* Origin done; drop to DRAIN and flush the remainder */
+                conn->complete = true;
+                epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->ufd, NULL);
+                close(conn->ufd);
+                conn->ufd = -1;
+                conn->state = ST_DRAIN;
+                if (econn_out_flush(conn) < 0) {
+                    econn_close(loop, conn);
+                    return;
+                }
+                if (conn->outlen == conn->outoff) {
+                    econn_finish(loop, conn);
+                } else {
+                    econn_update(loop, conn);
+                }
+                return;
+            }
+            if (!econn_out_append(conn, buf, (size_t)n)) {
+                econn_close(loop, conn);
+                return;
+            }
+            if (conn->object != NULL) {
+                if (conn->objectLen + (size_t)n <= MAX_OBJECT_SIZE) {
+                    memcpy(conn->object + conn->objectLen, buf, (size_t)n);
+                    conn->objectLen += (size_t)n;
+                } else {
+                    free(conn->object);
+                    conn->object = NULL;
+                }
+            }
+            if (econn_out_flush(conn) < 0) {
+                econn_close(loop, conn);
+                return;
+            }
+        }
+    }
+    econn_update(loop, conn);
+}
+
+/**
+ * @brief Accepts all pending connections on the listening socket
+ *
+ * @param[in] loop - The owning event loop
+ */
+static void econn_accept(evloop_t *loop) {
+    while (true) {
+        int cfd = accept4(loop->listenfd, NULL, NULL, SOCK_NONBLOCK);
+        if (cfd < 0) {
+            return;
+        }
+        econn_t *conn = calloc(1, sizeof(econn_t));
+        if (conn == NULL) {
+            close(cfd);
+            return;
+        }
+        conn->cfd = cfd;
+        conn->ufd = -1;
+        conn->state = ST_READ_REQUEST;
+        conn->ctag.conn = conn;
+        conn->ctag.upstream = false;
+        conn->utag.conn = conn;
+        conn->utag.upstream = true;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &conn->ctag;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, cfd, &ev) < 0) {
+            close(cfd);
+            free(conn);
+        }
+    }
+}
+
+/**
+ * @brief One event loop; each loop thread runs this forever
+ *
+ * @param[in] arg - The listening socket descriptor, cast to a pointer
+ *
+ * @return Never returns
+ */
+static void *event_loop(void *arg) {
+    evloop_t loop;
+    loop.listenfd = (int)(long)arg;
+    loop.deadList = NULL;
+    loop.epfd = epoll_create1(0);
+    if (loop.epfd < 0) {
+        fprintf(stderr, "epoll_create1 failed\n");
+        return NULL;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; /* NULL tags the listening socket */
+    epoll_ctl(loop.epfd, EPOLL_CTL_ADD, loop.listenfd, &ev);
+
+    struct epoll_event events[EV_MAXEVENTS];
+    while (true) {
+        int n = epoll_wait(loop.epfd, events, EV_MAXEVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            evtag_t *tag = events[i].data.ptr;
+            if (tag == NULL) {
+                econn_accept(&loop);
+                continue;
+            }
+            if (tag->conn->dead) {
+                continue;
+            }
+            if (tag->upstream) {
+                econn_upstream_ready(&loop, tag->conn);
+            } else {
+                econn_client_ready(&loop, tag->conn);
+            }
+        }
+        /* Free connections closed during this batch */
+        while (loop.deadList != NULL) {
+            econn_t *dead = loop.deadList;
+            loop.deadList = dead->nextDead;
+            free(dead);
+        }
+    }
+    return NULL;
+}
+
+void event_run(int listenfd) {
+    /* The listening socket comes from blocking open_listenfd, and
+     * SOCK_NONBLOCK in accept4 only affects the accepted socket: the
+     * accept drain loop relies on EAGAIN to stop, so the listening fd
+     * itself must be nonblocking or a loop thread parks inside accept4
+     * until the next connection arrives */
+    int flags = fcntl(listenfd, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(listenfd, F_SETFL, flags | O_NONBLOCK);
+    }
+    long nloops = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nloops < EV_MIN_LOOPS) {
+        nloops = EV_MIN_LOOPS;
+    }
+    pthread_t tid;
+    for (long i = 1; i < nloops; i++) {
+        pthread_create(&tid, NULL, event_loop, (void *)(long)listenfd);
+    }
+    event_loop((void *)(long)listenfd);
+}
@@ -0,0 +1,33 @@
+/**
+ * @file event.h
+ * @brief Interface for the proxy's event-driven connection engine
+ *
+ * The event engine is an alternative to the blocking thread-per-
+ * connection design: one event-loop thread per core multiplexes all of
+ * its connections with epoll and non-blocking sockets, so a connection
+ * parked on a slow client costs a small state struct instead of a
+ * blocked thread and its stack. The engine drives the same URI
+ * processing, header filtering, object cache, and DNS cache the
+ * threaded path uses.
+ *
+ * In this mode each client connection carries a single transaction and
+ * the origin is asked to close after its response, so response
+ * completion is delimited by EOF rather than per-request framing.
+ *
+ * The engine is selected at startup with the -e flag.
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+/**
+ * @brief Runs the event-driven engine on the given listening socket
+ *
+ * Spawns one event-loop thread per online core (the calling thread
+ * becomes one of them) and never returns.
+ *
+ * @param[in] listenfd - Listening socket's file descriptor
+ */
+void event_run(int listenfd);
+
+#endif /* EVENT_H */
@@ -0,0 +1,136 @@
+/**
+ * @file negcache.c
+ * @brief Short-TTL cache of origins that are currently failing
+ *
+ * A fixed array of entries guarded by a mutex, in the same shape as the
+ * DNS cache: each entry holds one "host:port" key, a consecutive
+ * failure count, and the time its backoff window closes. The window
+ * starts at one second and doubles per consecutive failure up to a
+ * cap, so a brief blip costs one retry's delay while a real outage
+ * settles into long windows. When the table is full the entry whose
+ * window closes soonest is replaced - the origins that matter during
+ * an outage are exactly the ones with the longest windows.
+ */
+
+#include "negcache.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Number of failing origins tracked at once */
+#define NEGCACHE_ENTRIES 64
+
+/* Bound on stored keys; longer origins are never blocked */
+#define NEGCACHE_MAXKEY 280
+
+/* First window in seconds, doubled per consecutive failure */
+#define NEGCACHE_BASE_SECS 1
+
+/* Largest window a failing origin can accumulate */
+#define NEGCACHE_MAX_SECS 64
+
+/**
+ * @brief One failing origin's record
+ */
+typedef struct {
+    char key[NEGCACHE_MAXKEY]; /* "host:port", empty if slot unused */
+    int fails;                 /* Consecutive failures recorded */
+    time_t until;              /* When the backoff window closes */
+} neg_entry_t;
+
+static struct {
+    neg_entry_t entries[NEGCACHE_ENTRIES];
+    pthread_mutex_t mutex;
+} negcache;
+
+void negcache_init(void) {
+    memset(negcache.entries, 0, sizeof(negcache.entries));
+    pthread_mutex_init(&negcache.mutex, NULL);
+}
+
+/**
+ * @brief Formats the "host:port" key for an origin
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ * @param[out] key - Buffer of NEGCACHE_MAXKEY bytes
+ *
+ * @return true if the key fit
+ */
+static bool negcache_key(const char *host, int port, char *key) {
+    return snprintf(key, NEGCACHE_MAXKEY, "%s:%d", host, port) <
+           NEGCACHE_MAXKEY;
+}
+
+bool negcache_blocked(const char *host, int port) {
+    char key[NEGCACHE_MAXKEY];
+    if (!negcache_key(host, port, key)) {
+        return false;
+    }
+    bool blocked = false;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&negcache.mutex);
+    for (int i = 0; i < NEGCACHE_ENTRIES; i++) {
+        if (negcache.entries[i].key[0] != '\0' &&
+            strcmp(negcache.entries[i].key, key) == 0) {
+            blocked = negcache.entries[i].until > now;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&negcache.mutex);
+    return blocked;
+}
+
+void negcache_fail(const char *host, int port) {
+    char key[NEGCACHE_MAXKEY];
+    if (!negcache_key(host, port, key)) {
+        return;
+    }
+    time_t now = time(NULL);
+    pthread_mutex_lock(&negcache.mutex);
+    int victim = 0;
+    for (int i = 0; i < NEGCACHE_ENTRIES; i++) {
+        if (negcache.entries[i].key[0] == '\0') {
+            victim = i;
+            break;
+        }
+        if (strcmp(negcache.entries[i].key, key) == 0) {
+            victim = i;
+            break;
+        }
+        if (negcache.entries[i].until < negcache.entries[victim].until) {
+            victim = i;
+        }
+    }
+    neg_entry_t *entry = &negcache.entries[victim];
+    if (strcmp(entry->key, key) != 0) {
+        strcpy(entry->key, key);
+        entry->fails = 0;
+    }
+    int secs = NEGCACHE_BASE_SECS << entry->fails;
+    if (secs > NEGCACHE_MAX_SECS) {
+        secs = NEGCACHE_MAX_SECS;
+    } else {
+        entry->fails++;
+    }
+    entry->until = now + secs;
+    pthread_mutex_unlock(&negcache.mutex);
+}
+
+void negcache_ok(const char *host, int port) {
+    char key[NEGCACHE_MAXKEY];
+    if (!negcache_key(host, port, key)) {
+        return;
+    }
+    pthread_mutex_lock(&negcache.mutex);
+    for (int i = 0; i < NEGCACHE_ENTRIES; i++) {
+        if (negcache.entries[i].key[0] != '\0' &&
+            strcmp(negcache.entries[i].key, key) == 0) {
+            negcache.entries[i].key[0] = '\0';
+            break;
+        }
+    }
+    pthread_mutex_unlock(&negcache.mutex);
+}
@@ -0,0 +1,54 @@
+/**
+ * @file negcache.h
+ * @brief Interface for the per-origin failure micro-cache
+ *
+ * Failed connects and 5xx responses are recorded per (host, port) with
+ * an exponentially growing backoff window. While an origin is inside
+ * its window, requests fail fast from memory - or fall back to a stale
+ * cached copy - instead of each burning a worker thread on the full
+ * connect timeout, so an outage costs microseconds per retry rather
+ * than multiplying into thousands of blocked threads. Any success
+ * clears the origin's record immediately.
+ */
+
+#ifndef NEGCACHE_H
+#define NEGCACHE_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Initializes the failure cache
+ *
+ * Must be called once before any other negcache function.
+ */
+void negcache_init(void);
+
+/**
+ * @brief Checks whether an origin is inside its backoff window
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ *
+ * @return true if requests to the origin should fail fast
+ */
+bool negcache_blocked(const char *host, int port);
+
+/**
+ * @brief Records a failed connect or 5xx response for an origin
+ *
+ * Each consecutive failure doubles the backoff window up to a cap.
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ */
+void negcache_fail(const char *host, int port);
+
+/**
+ * @brief Clears an origin's failure record after a success
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ */
+void negcache_ok(const char *host, int port);
+
+#endif /* NEGCACHE_H */
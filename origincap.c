@@ -0,0 +1,209 @@
+/**
+ * @file origincap.c
+ * @brief Per-origin in-flight quotas with small fair wait queues
+ *
+ * A fixed table of origin entries guarded by one mutex, each with its
+ * own condition variable. Acquiring a slot under the quota is a lookup
+ * and an increment; at the quota the caller joins the origin's queue
+ * and waits on its condition with a deadline, so a stalled backend
+ * costs a bounded short wait rather than an unbounded pile-up. Slots
+ * free in FIFO-ish cond-signal order, which is fair enough across a
+ * handful of waiters; the hard bounds (quota, queue depth, wait
+ * budget) are what keep one origin from absorbing the pool.
+ *
+ * Entries pin their table index while any worker holds or awaits a
+ * slot, so a handle is stable for the holder's lifetime; only fully
+ * idle entries are recycled for new origins.
+ */
+
+#include "origincap.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Origins tracked at once; beyond this, traffic proceeds ungated */
+#define ORIGINCAP_ENTRIES 64
+
+/* Bound on stored keys; longer origins are never gated */
+#define ORIGINCAP_MAXKEY 280
+
+/* Default in-flight quota per origin */
+#define ORIGINCAP_DEFAULT 8
+
+/* Waiters one origin may queue; beyond this, callers fail fast */
+#define ORIGINCAP_QUEUE 16
+
+/* Longest a caller waits for a slot, in seconds */
+#define ORIGINCAP_WAIT_SECS 5
+
+/**
+ * @brief One origin's gate
+ */
+typedef struct {
+    char key[ORIGINCAP_MAXKEY]; /* "host:port", empty if slot unused */
+    int active;                 /* Workers holding a slot */
+    int queued;                 /* Workers waiting for a slot */
+    unsigned long waits;        /* Queued acquisitions completed */
+    unsigned long long waitUs;  /* Time those acquisitions queued */
+    pthread_cond_t slotFree;    /* Signaled when a slot frees */
+} cap_entry_t;
+
+static struct {
+    cap_entry_t entries[ORIGINCAP_ENTRIES];
+    int quota;
+    pthread_mutex_t mutex;
+} caps;
+
+void origincap_init(void) {
+    memset(caps.entries, 0, sizeof(caps.entries));
+    for (int i = 0; i < ORIGINCAP_ENTRIES; i++) {
+        pthread_cond_init(&caps.entries[i].slotFree, NULL);
+    }
+    caps.quota = ORIGINCAP_DEFAULT;
+    const char *env = getenv("PROXY_ORIGIN_MAX");
+    if (env != NULL && atoi(env) > 0) {
+        caps.quota = atoi(env);
+    }
+    pthread_mutex_init(&caps.mutex, NULL);
+}
+
+/**
+ * @brief Microseconds on the monotonic clock
+ *
+ * @return The current time in microseconds
+ */
+static uint64_t origincap_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Finds or creates the entry for a key
+ *
+ * Must be called with the mutex held. Only fully idle entries are
+ * recycled, so indexes held by active workers stay valid.
+ *
+ * @param[in] key - The "host:port" key
+ *
+ * @return The entry's index, or -1 if the table is full
+ */
+static int origincap_entry(const char *key) {
+    int spare = -1;
+    for (int i = 0; i < ORIGINCAP_ENTRIES; i++) {
+        cap_entry_t *entry = &caps.entries[i];
+        if (entry->key[0] != '\0' && strcmp(entry->key, key) == 0) {
+            return i;
+        }
+        if (spare < 0 && entry->active == 0 && entry->queued == 0) {
+            spare = i;
+        }
+    }
+    if (spare >= 0) {
+        cap_entry_t *entry = &caps.entries[spare];
+        strcpy(entry->key, key);
+        entry->waits = 0;
+        entry->waitUs = 0;
+    }
+    return spare;
+}
+
+int origincap_acquire(const char *host, int port, uint64_t *waitedUs) {
+    *waitedUs = 0;
+    char key[ORIGINCAP_MAXKEY];
+    if (snprintf(key, sizeof(key), "%s:%d", host, port) >= (int)sizeof(key)) {
+        return ORIGINCAP_UNTRACKED;
+    }
+
+    pthread_mutex_lock(&caps.mutex);
+    int idx = origincap_entry(key);
+    if (idx < 0) {
+        pthread_mutex_unlock(&caps.mutex);
+        return ORIGINCAP_UNTRACKED;
+    }
+    cap_entry_t *entry = &caps.entries[idx];
+
+    if (entry->active >= caps.quota) {
+        if (entry->queued >= ORIGINCAP_QUEUE) {
+            pthread_mutex_unlock(&caps.mutex);
+            return ORIGINCAP_BUSY;
+        }
+        uint64_t start = origincap_now();
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ORIGINCAP_WAIT_SECS;
+        entry->queued++;
+        while (entry->active >= caps.quota) {
+            if (pthread_cond_timedwait(&entry->slotFree, &caps.mutex,
+                                       &deadline) != 0 &&
+                entry->active >= caps.quota) {
+                entry->queued--;
+                pthread_mutex_unlock(&caps.mutex);
+                return ORIGINCAP_BUSY;
+            }
+        }
+        entry->queued--;
+        entry->waits++;
+        uint64_t waited = origincap_now() - start;
+        entry->waitUs += waited;
+        *waitedUs = waited;
+    }
+    entry->active++;
+    pthread_mutex_unlock(&caps.mutex);
+    return idx;
+}
+
+void origincap_release(int handle) {
+    if (handle < 0) {
+        return;
+    }
+    pthread_mutex_lock(&caps.mutex);
+    cap_entry_t *entry = &caps.entries[handle];
+    entry->active--;
+    pthread_cond_signal(&entry->slotFree);
+    pthread_mutex_unlock(&caps.mutex);
+}
+
+size_t origincap_stats(char *buf, size_t cap) {
+    size_t used = 0;
+    int written = snprintf(buf, cap, ",\"origins\":[");
+    if (written < 0 || (size_t)written >= cap) {
+        return 0;
+    }
+    used = (size_t)written;
+
+    bool first = true;
+    pthread_mutex_lock(&caps.mutex);
+    for (int i = 0; i < ORIGINCAP_ENTRIES; i++) {
+        cap_entry_t *entry = &caps.entries[i];
+        if (entry->key[0] == '\0' ||
+            (entry->active == 0 && entry->queued == 0 &&
+             entry->waits == 0)) {
+            continue;
+        }
+        unsigned long long avg =
+            entry->waits > 0 ? entry->waitUs / entry->waits : 0;
+        written = snprintf(buf + used, cap - used,
+                           "%s{\"origin\":\"%s\",\"active\":%d,"
+                           "\"queued\":%d,\"wait_us_avg\":%llu}",
+                           first ? "" : ",", entry->key, entry->active,
+                           entry->queued, avg);
+        if (written < 0 || (size_t)written >= cap - used) {
+            pthread_mutex_unlock(&caps.mutex);
+            return 0;
+        }
+        used += (size_t)written;
+        first = false;
+    }
+    pthread_mutex_unlock(&caps.mutex);
+
+    written = snprintf(buf + used, cap - used, "]");
+    if (written < 0 || (size_t)written >= cap - used) {
+        return 0;
+    }
+    return used + (size_t)written;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file origincap.h
+ * @brief Interface for per-origin concurrency limiting
+ *
+ * Each (host, port) may hold at most a fixed quota of workers at once;
+ * requests beyond the quota wait briefly in a small per-origin queue
+ * for a slot, and requests beyond the queue are rejected immediately.
+ * A single degraded backend can therefore absorb only its quota of the
+ * worker pool while throughput to healthy origins stays flat. Each
+ * origin has its own condition variable, so waiters for one origin
+ * never contend with traffic to another beyond the shared table lock.
+ *
+ * The quota defaults per origin and can be overridden with the
+ * PROXY_ORIGIN_MAX environment variable. Queue depth and accumulated
+ * wait time per origin are exported to the stats endpoint.
+ */
+
+#ifndef ORIGINCAP_H
+#define ORIGINCAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returned when the table is full; the request proceeds ungated */
+#define ORIGINCAP_UNTRACKED -1
+
+/* Returned when the origin's queue is full or the wait expired */
+#define ORIGINCAP_BUSY -2
+
+/**
+ * @brief Initializes the table and reads the quota override
+ *
+ * Must be called once before any other origincap function.
+ */
+void origincap_init(void);
+
+/**
+ * @brief Acquires an in-flight slot for an origin, waiting if needed
+ *
+ * @param[in] host - The origin's hostname
+ * @param[in] port - The origin's numeric port
+ * @param[out] waitedUs - Receives how long the caller queued, if at all
+ *
+ * @return A handle to release, or ORIGINCAP_UNTRACKED to proceed
+ * ungated, or ORIGINCAP_BUSY if the caller should fail fast
+ */
+int origincap_acquire(const char *host, int port, uint64_t *waitedUs);
+
+/**
+ * @brief Releases a slot and wakes one queued waiter
+ *
+ * Must be called exactly once per handle origincap_acquire returned;
+ * ORIGINCAP_UNTRACKED and ORIGINCAP_BUSY are no-ops.
+ *
+ * @param[in] handle - Handle returned by origincap_acquire
+ */
+void origincap_release(int handle);
+
+/**
+ * @brief Renders the per-origin gate state as a JSON fragment
+ *
+ * Writes ,"origins":[...] (leading comma included) listing every
+ * tracked origin's active count, queue depth, and average queue wait.
+ *
+ * @param[out] buf - The output buffer
+ * @param[in] cap - The buffer's capacity
+ *
+ * @return Bytes written, or 0 if the fragment did not fit
+ */
+size_t origincap_stats(char *buf, size_t cap);
+
+#endif /* ORIGINCAP_H */
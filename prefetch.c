@@ -0,0 +1,344 @@
+/**
+ * @file prefetch.c
+ * @brief Background workers that warm the cache with a page's assets
+ *
+ * The scanner walks a cached HTML response for src and href attributes
+ * and enqueues the same-origin ones; a small pool of worker threads
+ * drains the queue, fetching each asset over a pooled upstream
+ * connection and storing the response in the object cache under the
+ * same key the request path would use. Everything is best-effort: a
+ * full queue drops the URL, an already-cached asset is skipped, and a
+ * response the cache cannot hold is discarded.
+ */
+
+#include "prefetch.h"
+
+#include "cache.h"
+#include "connpool.h"
+#include "negcache.h"
+#include "origincap.h"
+#include "csapp.h"
+#include "timeout.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/* Background fetcher threads */
+#define PREFETCH_THREADS 2
+
+/* Bounded job queue; overflow is dropped, never waited on */
+#define PREFETCH_QUEUE 128
+
+/* Most assets enqueued per scanned page */
+#define PREFETCH_PER_PAGE 32
+
+/* Bounds mirroring the request path's URI components */
+#define PREFETCH_HOST 256
+#define PREFETCH_PORT 16
+#define PREFETCH_PATH 2048
+
+/**
+ * @brief One asset waiting to be fetched
+ */
+typedef struct {
+    char host[PREFETCH_HOST];
+    int port;
+    char path[PREFETCH_PATH];
+    bool gzipVariant; /* Which encoding variant to warm */
+} prefetch_job_t;
+
+static struct {
+    prefetch_job_t jobs[PREFETCH_QUEUE];
+    int head;
+    int tail;
+    int count;
+    bool enabled;
+    pthread_mutex_t mutex;
+    pthread_cond_t nonempty;
+} pf;
+
+/**
+ * @brief Fetches one asset and stores the response in the cache
+ *
+ * The response is accumulated exactly as the request path caches it
+ * (status line, headers, body) so a later hit replays verbatim. Chunked
+ * bodies, non-200 statuses, and oversized responses are discarded; the
+ * upstream socket goes back to the pool only when the body was cleanly
+ * framed and fully drained.
+ *
+ * @param[in] job - The asset to fetch
+ */
+static void prefetch_fetch(const prefetch_job_t *job) {
+    //The key must match the request path's: (host:port path, variant)
+    char key[PREFETCH_HOST + PREFETCH_PORT + PREFETCH_PATH + 4];
+    if (snprintf(key, sizeof(key), "%s:%d%s#%s", job->host, job->port,
+                 job->path, job->gzipVariant ? "gz" : "id") >=
+        (int)sizeof(key)) {
+        return;
+    }
+
+    char *object = malloc(MAX_OBJECT_SIZE);
+    if (object == NULL) {
+        return;
+    }
+
+    //Skip assets a concurrent request (or an earlier prefetch) already
+    //brought in
+    if (cache_get(key, object, MAX_OBJECT_SIZE) >= 0) {
+        free(object);
+        return;
+    }
+
+    //Speculative fetches respect the origin's backoff window and its
+    //concurrency quota; they never queue for a slot
+    if (negcache_blocked(job->host, job->port)) {
+        free(object);
+        return;
+    }
+    uint64_t gateWaitUs = 0;
+    int gate = origincap_acquire(job->host, job->port, &gateWaitUs);
+    if (gate == ORIGINCAP_BUSY) {
+        free(object);
+        return;
+    }
+    bool reusedConn = false;
+    int serverFd = connpool_get(job->host, job->port, &reusedConn);
+    if (serverFd < 0) {
+        negcache_fail(job->host, job->port);
+        origincap_release(gate);
+        free(object);
+        return;
+    }
+    int srvTmo = timeout_arm(serverFd, timeout_relay_secs());
+
+    char buf[MAXLINE];
+    int reqLen = snprintf(buf, sizeof(buf),
+                          "GET %s HTTP/1.1\r\n"
+                          "Host: %s:%d\r\n"
+                          "Connection: keep-alive\r\n"
+                          "%s\r\n",
+                          job->path, job->host, job->port,
+                          job->gzipVariant ? "Accept-Encoding: gzip\r\n" : "");
+    if (reqLen <= 0 || reqLen >= (int)sizeof(buf) ||
+        rio_writen(serverFd, buf, (size_t)reqLen) < 0) {
+        free(object);
+        timeout_disarm(srvTmo);
+        origincap_release(gate);
+        close(serverFd);
+        return;
+    }
+
+    rio_t server;
+    rio_readinitb(&server, serverFd);
+
+    //Read the head, keeping the framing and the validators
+    size_t objectLen = 0;
+    long contentLength = -1;
+    bool chunked = false;
+    bool serverClose = false;
+    int status = 0;
+    cache_validators_t validators = {"", ""};
+    ssize_t lineLen = rio_readb_until(&server, buf, MAXLINE, '\n');
+    if (lineLen > 0) {
+        sscanf(buf, "HTTP/%*s %d", &status);
+    }
+    for (; lineLen > 0; lineLen = rio_readb_until(&server, buf, MAXLINE,
+                                                  '\n')) {
+        if (objectLen + (size_t)lineLen > MAX_OBJECT_SIZE) {
+            lineLen = -1;
+            break;
+        }
+        memcpy(object + objectLen, buf, (size_t)lineLen);
+        objectLen += (size_t)lineLen;
+        if (strncasecmp(buf, "Content-Length:", 15) == 0) {
+            contentLength = atol(buf + 15);
+        } else if (strncasecmp(buf, "Transfer-Encoding: chunked", 26) == 0) {
+            chunked = true;
+        } else if (strncasecmp(buf, "Connection: close", 17) == 0) {
+            serverClose = true;
+        } else if (strncasecmp(buf, "ETag:", 5) == 0) {
+            size_t n = strcspn(buf + 5, "\r\n");
+            const char *value = buf + 5;
+            while (*value == ' ' && n > 0) {
+                value++;
+                n--;
+            }
+            if (n < CACHE_VAL_MAX) {
+                memcpy(validators.etag, value, n);
+                validators.etag[n] = '\0';
+            }
+        }
+        if (strcmp(buf, "\r\n") == 0) {
+            break;
+        }
+    }
+
+    //Only cleanly framed 200s that fit the cache are worth keeping
+    if (lineLen <= 0 || status != 200 || chunked || contentLength < 0 ||
+        objectLen + (size_t)contentLength > MAX_OBJECT_SIZE) {
+        free(object);
+        timeout_disarm(srvTmo);
+        origincap_release(gate);
+        close(serverFd);
+        return;
+    }
+
+    long remaining = contentLength;
+    while (remaining > 0) {
+        ssize_t got = rio_readnb(&server, object + objectLen,
+                                 (size_t)remaining);
+        if (got <= 0) {
+            free(object);
+            timeout_disarm(srvTmo);
+            origincap_release(gate);
+            close(serverFd);
+            return;
+        }
+        objectLen += (size_t)got;
+        remaining -= got;
+    }
+
+    cache_put_validated(key, object, objectLen, &validators);
+    free(object);
+    timeout_disarm(srvTmo);
+    origincap_release(gate);
+    connpool_release(serverFd, job->host, job->port, !serverClose);
+}
+
+/**
+ * @brief Worker thread: drains the job queue forever
+ *
+ * @param[in] arg - Unused
+ *
+ * @return Never returns
+ */
+static void *prefetch_worker(void *arg) {
+    (void)arg;
+    pthread_detach(pthread_self());
+    while (1) {
+        pthread_mutex_lock(&pf.mutex);
+        while (pf.count == 0) {
+            pthread_cond_wait(&pf.nonempty, &pf.mutex);
+        }
+        prefetch_job_t job = pf.jobs[pf.head];
+        pf.head = (pf.head + 1) % PREFETCH_QUEUE;
+        pf.count--;
+        pthread_mutex_unlock(&pf.mutex);
+        prefetch_fetch(&job);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Enqueues one asset, dropping it if the queue is full
+ *
+ * @param[in] host - The origin host
+ * @param[in] port - The origin port
+ * @param[in] path - The asset's path, starting with '/'
+ * @param[in] pathLen - The path's length
+ * @param[in] gzipVariant - Which encoding variant to warm
+ */
+static void prefetch_submit(const char *host, int port, const char *path,
+                            size_t pathLen, bool gzipVariant) {
+    if (pathLen == 0 || pathLen >= PREFETCH_PATH ||
+        strlen(host) >= PREFETCH_HOST) {
+        return;
+    }
+    pthread_mutex_lock(&pf.mutex);
+    if (pf.count < PREFETCH_QUEUE) {
+        prefetch_job_t *job = &pf.jobs[pf.tail];
+        strcpy(job->host, host);
+        job->port = port;
+        memcpy(job->path, path, pathLen);
+        job->path[pathLen] = '\0';
+        job->gzipVariant = gzipVariant;
+        pf.tail = (pf.tail + 1) % PREFETCH_QUEUE;
+        pf.count++;
+        pthread_cond_signal(&pf.nonempty);
+    }
+    pthread_mutex_unlock(&pf.mutex);
+}
+
+void prefetch_init(const char *enable) {
+    if (enable == NULL || enable[0] == '\0') {
+        return;
+    }
+    pf.head = 0;
+    pf.tail = 0;
+    pf.count = 0;
+    pthread_mutex_init(&pf.mutex, NULL);
+    pthread_cond_init(&pf.nonempty, NULL);
+    for (int i = 0; i < PREFETCH_THREADS; i++) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, prefetch_worker, NULL);
+    }
+    pf.enabled = true;
+}
+
+void prefetch_scan(const char *body, size_t len, const char *host, int port,
+                   bool gzipVariant) {
+    if (!pf.enabled) {
+        return;
+    }
+    size_t hostLen = strlen(host);
+    char portStr[PREFETCH_PORT];
+    size_t portLen =
+        (size_t)snprintf(portStr, sizeof(portStr), "%d", port);
+    int submitted = 0;
+    for (size_t i = 0; i + 5 < len && submitted < PREFETCH_PER_PAGE; i++) {
+        //Match src= or href= followed by a quote
+        size_t attr = 0;
+        if ((body[i] == 's' || body[i] == 'S') &&
+            strncasecmp(body + i, "src=", 4) == 0) {
+            attr = 4;
+        } else if ((body[i] == 'h' || body[i] == 'H') &&
+                   strncasecmp(body + i, "href=", 5) == 0) {
+            attr = 5;
+        }
+        if (attr == 0) {
+            continue;
+        }
+        size_t at = i + attr;
+        if (at >= len || (body[at] != '"' && body[at] != '\'')) {
+            continue;
+        }
+        char quote = body[at];
+        at++;
+        const char *value = body + at;
+        const char *close = memchr(value, quote, len - at);
+        if (close == NULL) {
+            continue;
+        }
+        size_t valueLen = (size_t)(close - value);
+        i = at + valueLen;
+
+        //Same-origin only: a rooted path, or an absolute URL naming
+        //this host (with the page's port or none)
+        if (valueLen > 0 && value[0] == '/') {
+            prefetch_submit(host, port, value, valueLen, gzipVariant);
+            submitted++;
+        } else if (valueLen > 7 + hostLen &&
+                   strncasecmp(value, "http://", 7) == 0 &&
+                   strncasecmp(value + 7, host, hostLen) == 0) {
+            const char *rest = value + 7 + hostLen;
+            size_t restLen = valueLen - 7 - hostLen;
+            if (restLen > 0 && rest[0] == ':') {
+                if (restLen <= portLen ||
+                    strncmp(rest + 1, portStr, portLen) != 0 ||
+                    rest[1 + portLen] != '/') {
+                    continue;
+                }
+                rest += 1 + portLen;
+                restLen -= 1 + portLen;
+            }
+            if (restLen > 0 && rest[0] == '/') {
+                prefetch_submit(host, port, rest, restLen, gzipVariant);
+                submitted++;
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file prefetch.h
+ * @brief Interface for speculative prefetch of a page's embedded assets
+ *
+ * When a fetched HTML page lands in the object cache, its same-origin
+ * src/href URLs are extracted and fetched in the background over pooled
+ * upstream connections, so the asset requests that follow the page hit
+ * warm cache instead of each paying a cold round trip. Prefetching is
+ * strictly best-effort: the queue is bounded and overflow is dropped,
+ * workers skip anything already cached, and nothing on the client's
+ * request path ever waits for a prefetch.
+ *
+ * The stage is off unless enabled, since it spends origin bandwidth on
+ * speculation.
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Starts the prefetch workers if the stage is enabled
+ *
+ * Must be called once at startup, after the cache and connection pool
+ * are initialized.
+ *
+ * @param[in] enable - Value of PROXY_PREFETCH; NULL or empty disables
+ * the stage
+ */
+void prefetch_init(const char *enable);
+
+/**
+ * @brief Scans an HTML response for same-origin assets to prefetch
+ *
+ * Returns immediately; extracted URLs are fetched by the background
+ * workers. Does nothing when the stage is disabled.
+ *
+ * @param[in] body - The response bytes (head and body) as cached
+ * @param[in] len - The response's length
+ * @param[in] host - The origin host the page came from
+ * @param[in] port - The origin's numeric port
+ * @param[in] gzipVariant - Whether the triggering client accepts gzip,
+ * deciding which cache variant the assets are warmed under
+ */
+void prefetch_scan(const char *body, size_t len, const char *host, int port,
+                   bool gzipVariant);
+
+#endif /* PREFETCH_H */
@@ -0,0 +1,220 @@
+/**
+ * @file stats.c
+ * @brief Per-thread request counters and latency histograms
+ *
+ * Each worker thread owns one slot sized and aligned to a cache line
+ * multiple, so recording a request is a handful of stores to memory no
+ * other thread writes - there is no false sharing and nothing to
+ * contend on. Latencies are bucketed by the position of their highest
+ * set bit (power-of-two microsecond buckets), which makes recording a
+ * single increment and lets percentiles be answered from bucket counts
+ * without storing samples.
+ *
+ * stats_render walks every claimed slot with plain loads. A render that
+ * races with recording can see a count that is one off; monitoring
+ * output does not need better than that, and the request path stays
+ * free of synchronization in return.
+ */
+
+#include "stats.h"
+#include "origincap.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Worker threads that can have their own slot; later threads are unrecorded */
+#define STATS_THREADS 64
+
+/* Power-of-two microsecond buckets; bucket i holds [2^(i-1), 2^i) */
+#define STATS_BUCKETS 40
+
+/**
+ * @brief One thread's counters and histograms
+ */
+typedef struct {
+    bool used;                /* Slot has been claimed by a thread */
+    long active;              /* Connections this thread is serving */
+    unsigned long requests;   /* Requests completed */
+    unsigned long hits;       /* Requests served from a cache tier */
+    unsigned long long bytes; /* Bytes relayed to clients */
+    unsigned long latency[STATS_BUCKETS];   /* Request start to last byte */
+    unsigned long firstByte[STATS_BUCKETS]; /* Request start to first byte */
+    unsigned long connect[STATS_BUCKETS];   /* Request start to connect */
+} __attribute__((aligned(64))) stats_thread_t;
+
+static struct {
+    stats_thread_t threads[STATS_THREADS];
+    unsigned long claimed; /* Slots handed out so far */
+} stats;
+
+/* This thread's slot, or NULL if none is claimed yet or all are taken */
+static __thread stats_thread_t *statsSelf = NULL;
+static __thread bool statsTried = false;
+
+void stats_init(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * @brief Returns the calling thread's slot, claiming one on first use
+ *
+ * The claim is the only atomic operation on the recording path and runs
+ * once per thread lifetime.
+ *
+ * @return The slot, or NULL if all slots are taken
+ */
+static stats_thread_t *stats_self(void) {
+    if (!statsTried) {
+        statsTried = true;
+        unsigned long slot =
+            __atomic_fetch_add(&stats.claimed, 1, __ATOMIC_RELAXED);
+        if (slot < STATS_THREADS) {
+            statsSelf = &stats.threads[slot];
+            statsSelf->used = true;
+        }
+    }
+    return statsSelf;
+}
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Finds the histogram bucket for a duration
+ *
+ * @param[in] us - The duration in microseconds
+ *
+ * @return The bucket index (position of the highest set bit)
+ */
+static int stats_bucket(uint64_t us) {
+    int bucket = 0;
+    while (us > 1 && bucket < STATS_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void stats_conn_begin(void) {
+    stats_thread_t *self = stats_self();
+    if (self != NULL) {
+        self->active++;
+    }
+}
+
+void stats_conn_end(void) {
+    stats_thread_t *self = stats_self();
+    if (self != NULL) {
+        self->active--;
+    }
+}
+
+void stats_record(uint64_t startUs, uint64_t connectUs, uint64_t firstByteUs,
+                  uint64_t endUs, size_t bytes, bool hit) {
+    stats_thread_t *self = stats_self();
+    if (self == NULL) {
+        return;
+    }
+    self->requests++;
+    if (hit) {
+        self->hits++;
+    }
+    self->bytes += bytes;
+    self->latency[stats_bucket(endUs - startUs)]++;
+    if (firstByteUs != 0) {
+        self->firstByte[stats_bucket(firstByteUs - startUs)]++;
+    }
+    if (connectUs != 0) {
+        self->connect[stats_bucket(connectUs - startUs)]++;
+    }
+}
+
+/**
+ * @brief Answers a percentile from an aggregated histogram
+ *
+ * @param[in] hist - Aggregated bucket counts
+ * @param[in] total - Sum of all bucket counts
+ * @param[in] pct - The percentile to answer (0-100)
+ *
+ * @return The bucket's upper bound in microseconds, or 0 with no samples
+ */
+static uint64_t stats_percentile(const unsigned long *hist,
+                                 unsigned long total, int pct) {
+    if (total == 0) {
+        return 0;
+    }
+    unsigned long rank = (total * (unsigned long)pct + 99) / 100;
+    unsigned long seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= rank) {
+            return (uint64_t)1 << i;
+        }
+    }
+    return (uint64_t)1 << (STATS_BUCKETS - 1);
+}
+
+size_t stats_render(char *buf, size_t cap) {
+    unsigned long requests = 0;
+    unsigned long hits = 0;
+    unsigned long long bytes = 0;
+    long active = 0;
+    unsigned long latency[STATS_BUCKETS] = {0};
+    unsigned long firstByte[STATS_BUCKETS] = {0};
+    unsigned long connect[STATS_BUCKETS] = {0};
+    unsigned long latencyTotal = 0;
+    unsigned long firstByteTotal = 0;
+    unsigned long connectTotal = 0;
+
+    for (int t = 0; t < STATS_THREADS; t++) {
+        stats_thread_t *slot = &stats.threads[t];
+        if (!slot->used) {
+            continue;
+        }
+        requests += slot->requests;
+        hits += slot->hits;
+        bytes += slot->bytes;
+        active += slot->active;
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+            latency[i] += slot->latency[i];
+            latencyTotal += slot->latency[i];
+            firstByte[i] += slot->firstByte[i];
+            firstByteTotal += slot->firstByte[i];
+            connect[i] += slot->connect[i];
+            connectTotal += slot->connect[i];
+        }
+    }
+
+    double hitRatio = requests > 0 ? (double)hits / (double)requests : 0.0;
+    int len = snprintf(
+        buf, cap,
+        "{\"requests\":%lu,"
+        "\"active_connections\":%ld,"
+        "\"cache_hits\":%lu,"
+        "\"cache_hit_ratio\":%.4f,"
+        "\"bytes_relayed\":%llu,"
+        "\"latency_us\":{\"p50\":%llu,\"p99\":%llu},"
+        "\"first_byte_us\":{\"p50\":%llu,\"p99\":%llu},"
+        "\"connect_us\":{\"p50\":%llu,\"p99\":%llu}",
+        requests, active, hits, hitRatio, bytes,
+        (unsigned long long)stats_percentile(latency, latencyTotal, 50),
+        (unsigned long long)stats_percentile(latency, latencyTotal, 99),
+        (unsigned long long)stats_percentile(firstByte, firstByteTotal, 50),
+        (unsigned long long)stats_percentile(firstByte, firstByteTotal, 99),
+        (unsigned long long)stats_percentile(connect, connectTotal, 50),
+        (unsigned long long)stats_percentile(connect, connectTotal, 99));
+    if (len < 0 || (size_t)len >= cap) {
+        return 0;
+    }
+    //The per-origin gate contributes its own fragment to the object
+    size_t used = (size_t)len + origincap_stats(buf + len, cap - (size_t)len);
+    int tail = snprintf(buf + used, cap - used, "}\n");
+    if (tail < 0 || (size_t)tail >= cap - used) {
+        return 0;
+    }
+    return used + (size_t)tail;
+}
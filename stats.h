@@ -0,0 +1,75 @@
+/**
+ * @file stats.h
+ * @brief Interface for the proxy's request instrumentation
+ *
+ * Counters and latency histograms are kept per worker thread, so the
+ * per-request path touches only memory the recording thread owns: no
+ * locks and no shared atomics. The one atomic operation a thread ever
+ * performs is claiming its slot on first use. Aggregation across
+ * threads happens only when the stats are rendered, with plain reads
+ * that may be momentarily torn - acceptable for monitoring output.
+ *
+ * Timestamps are taken by the caller with stats_now at the interesting
+ * points (request start, origin connect, first and last response byte)
+ * and handed to stats_record, which buckets the resulting durations
+ * into power-of-two microsecond histograms.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Initializes the stats subsystem
+ *
+ * Must be called once before any other stats function.
+ */
+void stats_init(void);
+
+/**
+ * @brief Returns the current monotonic time in microseconds
+ *
+ * @return Microseconds from an arbitrary fixed origin
+ */
+uint64_t stats_now(void);
+
+/**
+ * @brief Notes that the calling thread began serving a connection
+ */
+void stats_conn_begin(void);
+
+/**
+ * @brief Notes that the calling thread finished serving a connection
+ */
+void stats_conn_end(void);
+
+/**
+ * @brief Records one completed request into the calling thread's slot
+ *
+ * Stage timestamps of 0 mean the stage did not occur (a cache hit has
+ * no origin connect or first-byte time) and are skipped.
+ *
+ * @param[in] startUs - When handling of the request began
+ * @param[in] connectUs - When the origin connection was obtained, or 0
+ * @param[in] firstByteUs - When the first response byte arrived, or 0
+ * @param[in] endUs - When the last byte was relayed
+ * @param[in] bytes - Bytes relayed to the client
+ * @param[in] hit - Whether the response came from a cache tier
+ */
+void stats_record(uint64_t startUs, uint64_t connectUs, uint64_t firstByteUs,
+                  uint64_t endUs, size_t bytes, bool hit);
+
+/**
+ * @brief Renders the aggregated stats as a JSON object
+ *
+ * @param[out] buf - Buffer receiving the JSON text
+ * @param[in] cap - Capacity of buf
+ *
+ * @return The rendered length, or 0 if it would not fit
+ */
+size_t stats_render(char *buf, size_t cap);
+
+#endif /* STATS_H */
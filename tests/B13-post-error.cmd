@@ -1,6 +1,10 @@
-serve s1
-generate random-text.txt 4K
-post-request f1 random-text.txt s1
-wait *
-check f1 501
-quit
\ No newline at end of file
+# POST is forwarded to the origin, body framing intact, rather than
+# rejected by the proxy. The pxydrive server implements only GET, so
+# the 501 checked here is the origin's own answer relayed back through
+# the proxy - not a proxy-generated error as in earlier versions.
+serve s1
+generate random-text.txt 4K
+post-request f1 random-text.txt s1
+wait *
+check f1 501
+quit
@@ -0,0 +1,14 @@
+# A relayed POST must leave the proxy healthy: after the round trip to
+# the origin (which answers 501, being GET-only) the same proxy has to
+# keep serving ordinary fetches on fresh connections.
+serve s1
+generate random-text.txt 4K
+generate follow-up.txt 1K
+post-request f1 random-text.txt s1
+wait *
+check f1 501
+fetch f2 follow-up.txt s1
+wait *
+check f2
+trace f2
+quit
@@ -0,0 +1,249 @@
+/**
+ * @file timeout.c
+ * @brief Timer wheel that shuts down overdue connections
+ *
+ * The wheel is an array of buckets, one per second of horizon, each
+ * holding a doubly-linked list of armed entries. The sweeper thread
+ * advances the cursor once per second and shuts down every socket in
+ * the bucket it lands on; arming places an entry secs buckets ahead of
+ * the cursor. All operations are O(1) under one mutex, which is
+ * uncontended in practice since a request arms or moves its deadline
+ * only a handful of times.
+ *
+ * A fired entry is not freed by the sweeper: it stays FIRED until the
+ * owning thread disarms it on its teardown path. That keeps handle
+ * reuse impossible while an owner still holds one, at the cost of a
+ * fired slow connection occupying its entry slightly longer.
+ */
+
+#include "timeout.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Seconds of horizon; also the bucket count */
+#define TIMEOUT_WHEEL 512
+
+/* Bound on concurrently armed deadlines */
+#define TIMEOUT_MAX 4096
+
+/* Default per-stage budgets in seconds */
+#define TIMEOUT_HEADER_DEFAULT 15
+#define TIMEOUT_CONNECT_DEFAULT 5
+#define TIMEOUT_RELAY_DEFAULT 300
+
+/* Entry states */
+#define TMO_FREE 0
+#define TMO_ARMED 1
+#define TMO_FIRED 2
+
+/**
+ * @brief One armed (or fired) deadline
+ */
+typedef struct tmo_entry {
+    int fd;                 /* Socket to shut down when overdue */
+    int state;              /* TMO_FREE, TMO_ARMED, or TMO_FIRED */
+    int bucket;             /* Bucket the entry is armed in */
+    struct tmo_entry *prev; /* Previous entry in its bucket or free list */
+    struct tmo_entry *next; /* Next entry in its bucket or free list */
+} tmo_entry_t;
+
+static struct {
+    tmo_entry_t entries[TIMEOUT_MAX];
+    tmo_entry_t *buckets[TIMEOUT_WHEEL]; /* Armed entries per second */
+    tmo_entry_t *freeHead;               /* Unused entries */
+    int cursor;                          /* Bucket the sweeper visits next */
+    int headerSecs;
+    int connectSecs;
+    int relaySecs;
+    pthread_mutex_t mutex;
+} wheel;
+
+/**
+ * @brief Unlinks an entry from whatever list it is on
+ *
+ * Must be called with the mutex held; head is the list's head pointer.
+ *
+ * @param[in] entry - The entry to unlink
+ * @param[in] head - The list's head pointer
+ */
+static void tmo_unlink(tmo_entry_t *entry, tmo_entry_t **head) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        *head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    }
+}
+
+/**
+ * @brief Links an entry at the front of a list
+ *
+ * Must be called with the mutex held.
+ *
+ * @param[in] entry - The entry to link
+ * @param[in] head - The list's head pointer
+ */
+static void tmo_link(tmo_entry_t *entry, tmo_entry_t **head) {
+    entry->prev = NULL;
+    entry->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = entry;
+    }
+    *head = entry;
+}
+
+/**
+ * @brief Picks the bucket for a deadline the given seconds out
+ *
+ * Must be called with the mutex held. Budgets are clamped to the
+ * wheel's horizon.
+ *
+ * @param[in] secs - Seconds until the deadline
+ *
+ * @return The bucket index
+ */
+static int tmo_bucketFor(int secs) {
+    if (secs < 1) {
+        secs = 1;
+    }
+    if (secs > TIMEOUT_WHEEL - 1) {
+        secs = TIMEOUT_WHEEL - 1;
+    }
+    return (wheel.cursor + secs) % TIMEOUT_WHEEL;
+}
+
+/**
+ * @brief Sweeper thread: fires every bucket the cursor reaches
+ *
+ * @param[in] arg - Unused
+ *
+ * @return Never returns
+ */
+static void *timeout_sweeper(void *arg) {
+    (void)arg;
+    pthread_detach(pthread_self());
+    while (1) {
+        sleep(1);
+        pthread_mutex_lock(&wheel.mutex);
+        wheel.cursor = (wheel.cursor + 1) % TIMEOUT_WHEEL;
+        tmo_entry_t *entry = wheel.buckets[wheel.cursor];
+        while (entry != NULL) {
+            tmo_entry_t *next = entry->next;
+            //Wake whatever blocking call the owner is parked in; the
+            //owner tears the connection down and disarms the entry
+            shutdown(entry->fd, SHUT_RDWR);
+            entry->state = TMO_FIRED;
+            entry->prev = NULL;
+            entry->next = NULL;
+            entry = next;
+        }
+        wheel.buckets[wheel.cursor] = NULL;
+        pthread_mutex_unlock(&wheel.mutex);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads a budget override from the environment
+ *
+ * @param[in] name - The environment variable's name
+ * @param[in] fallback - Value used when unset or not positive
+ *
+ * @return The budget in seconds
+ */
+static int timeout_env(const char *name, int fallback) {
+    const char *value = getenv(name);
+    if (value != NULL && atoi(value) > 0) {
+        return atoi(value);
+    }
+    return fallback;
+}
+
+void timeout_init(void) {
+    for (int i = 0; i < TIMEOUT_MAX; i++) {
+        wheel.entries[i].state = TMO_FREE;
+        wheel.entries[i].prev = NULL;
+        wheel.entries[i].next = i + 1 < TIMEOUT_MAX ? &wheel.entries[i + 1]
+                                                    : NULL;
+        if (i + 1 < TIMEOUT_MAX) {
+            wheel.entries[i + 1].prev = &wheel.entries[i];
+        }
+    }
+    wheel.freeHead = &wheel.entries[0];
+    for (int i = 0; i < TIMEOUT_WHEEL; i++) {
+        wheel.buckets[i] = NULL;
+    }
+    wheel.cursor = 0;
+    wheel.headerSecs = timeout_env("PROXY_TIMEOUT_HEADER",
+                                   TIMEOUT_HEADER_DEFAULT);
+    wheel.connectSecs = timeout_env("PROXY_TIMEOUT_CONNECT",
+                                    TIMEOUT_CONNECT_DEFAULT);
+    wheel.relaySecs = timeout_env("PROXY_TIMEOUT_RELAY",
+                                  TIMEOUT_RELAY_DEFAULT);
+    pthread_mutex_init(&wheel.mutex, NULL);
+    pthread_t tid;
+    pthread_create(&tid, NULL, timeout_sweeper, NULL);
+}
+
+int timeout_arm(int fd, int secs) {
+    pthread_mutex_lock(&wheel.mutex);
+    tmo_entry_t *entry = wheel.freeHead;
+    if (entry == NULL) {
+        pthread_mutex_unlock(&wheel.mutex);
+        return -1;
+    }
+    tmo_unlink(entry, &wheel.freeHead);
+    entry->fd = fd;
+    entry->state = TMO_ARMED;
+    entry->bucket = tmo_bucketFor(secs);
+    tmo_link(entry, &wheel.buckets[entry->bucket]);
+    pthread_mutex_unlock(&wheel.mutex);
+    return (int)(entry - wheel.entries);
+}
+
+void timeout_rearm(int handle, int secs) {
+    if (handle < 0) {
+        return;
+    }
+    pthread_mutex_lock(&wheel.mutex);
+    tmo_entry_t *entry = &wheel.entries[handle];
+    if (entry->state == TMO_ARMED) {
+        tmo_unlink(entry, &wheel.buckets[entry->bucket]);
+        entry->bucket = tmo_bucketFor(secs);
+        tmo_link(entry, &wheel.buckets[entry->bucket]);
+    }
+    pthread_mutex_unlock(&wheel.mutex);
+}
+
+void timeout_disarm(int handle) {
+    if (handle < 0) {
+        return;
+    }
+    pthread_mutex_lock(&wheel.mutex);
+    tmo_entry_t *entry = &wheel.entries[handle];
+    if (entry->state == TMO_ARMED) {
+        tmo_unlink(entry, &wheel.buckets[entry->bucket]);
+    }
+    if (entry->state != TMO_FREE) {
+        entry->state = TMO_FREE;
+        tmo_link(entry, &wheel.freeHead);
+    }
+    pthread_mutex_unlock(&wheel.mutex);
+}
+
+int timeout_header_secs(void) {
+    return wheel.headerSecs;
+}
+
+int timeout_connect_secs(void) {
+    return wheel.connectSecs;
+}
+
+int timeout_relay_secs(void) {
+    return wheel.relaySecs;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file timeout.h
+ * @brief Interface for the proxy's connection deadline enforcement
+ *
+ * Deadlines are kept in a timer wheel swept once per second by one
+ * central thread. Arming, re-arming, and disarming are O(1) list
+ * operations, so a deliberately slow connection costs one small wheel
+ * entry instead of a parked worker thread. When a deadline fires the
+ * socket is shut down, which makes whatever blocking read or write the
+ * owning thread is parked in return an error; the owner then cleans up
+ * on its normal failure path and disarms the entry. Entries are only
+ * reused after the owner disarms them, so a late disarm can never hit
+ * another connection's entry.
+ *
+ * Budgets default per stage (header receipt, origin connect, body
+ * relay) and can be overridden with the PROXY_TIMEOUT_HEADER,
+ * PROXY_TIMEOUT_CONNECT, and PROXY_TIMEOUT_RELAY environment variables
+ * (seconds).
+ */
+
+#ifndef TIMEOUT_H
+#define TIMEOUT_H
+
+/**
+ * @brief Initializes the wheel and starts the sweeper thread
+ *
+ * Must be called once before any other timeout function.
+ */
+void timeout_init(void);
+
+/**
+ * @brief Arms a deadline for a socket
+ *
+ * @param[in] fd - The socket to shut down if the deadline passes
+ * @param[in] secs - Seconds until the deadline
+ *
+ * @return A handle for re-arming or disarming
+ * @return -1 if the wheel is full (the connection runs unbounded)
+ */
+int timeout_arm(int fd, int secs);
+
+/**
+ * @brief Moves an armed deadline further out
+ *
+ * A handle whose deadline has already fired stays fired; the connection
+ * is being torn down and extending it would be pointless.
+ *
+ * @param[in] handle - Handle returned by timeout_arm
+ * @param[in] secs - Seconds until the new deadline
+ */
+void timeout_rearm(int handle, int secs);
+
+/**
+ * @brief Releases a deadline's entry for reuse
+ *
+ * Must be called exactly once per successful timeout_arm, after the
+ * owner is done with the socket.
+ *
+ * @param[in] handle - Handle returned by timeout_arm
+ */
+void timeout_disarm(int handle);
+
+/**
+ * @brief Returns the header receipt budget in seconds
+ */
+int timeout_header_secs(void);
+
+/**
+ * @brief Returns the origin connect budget in seconds
+ */
+int timeout_connect_secs(void);
+
+/**
+ * @brief Returns the body relay budget in seconds
+ */
+int timeout_relay_secs(void);
+
+#endif /* TIMEOUT_H */